@@ -0,0 +1,365 @@
+// Node N-API addon (make node-addon) over the C interface of
+// libswitchres.h, so Node scripts can evaluate large batches natively
+// instead of on the main thread through the wasm module.
+//
+//   const switchres = require('.../out/node/switchres.node');
+//   const monitor = switchres.createMonitor(JSON.stringify(config));
+//   const {status, flags, modes, text} = await switchres.evalBatch(monitor, displays, {text: true});
+//
+// displays is a Float64Array with DISPLAY_FIELDS values per display (type,
+// rotate, flipx, width, height, refresh, the type as SWITCHRES_SCREEN_*).
+// It must not be changed until the promise settles. The batch is split in
+// chunks that run as async work on the libuv thread pool (so at most
+// UV_THREADPOOL_SIZE, 4 by default, at once). The results are typed arrays
+// over the buffers the workers wrote, no copy is made on the main thread:
+//   status Int32Array  SWITCHRES_OK or SWITCHRES_ERR_DISPLAY per display
+//   flags  Int32Array  SWITCHRES_* result flags per display
+//   modes  Float64Array modeFields values per display (zeroed when out of
+//          range or failed)
+//   text   string[]    the modeline or error message, with {text: true}
+
+#include "../src/libswitchres.h"
+#include <node_api.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DISPLAY_FIELDS 6
+#define MODE_FIELDS    15
+
+static const char *const mode_field_names[MODE_FIELDS] = {
+  "pclock", "hactive", "hbegin", "hend", "htotal", "vactive", "vbegin", "vend", "vtotal",
+  "interlace", "doublescan", "hsync", "vsync", "hfreq", "vfreq"
+};
+
+// a batch and the outputs its chunks write
+typedef struct t_addon_batch {
+  const t_switchres_monitor *monitor;
+  napi_ref                   monitor_ref;
+  napi_ref                   displays_ref;
+  const double              *displays;
+  size_t                     count;
+  bool                       with_text;
+  int                        pending;  // chunks not completed
+  bool                       failed;   // a chunk failed or was cancelled
+  napi_deferred              deferred;
+
+  // handed over to the result's array buffers
+  int32_t                   *status;
+  int32_t                   *flags;
+  double                    *modes;
+  std::vector<std::string>   text;
+} t_addon_batch;
+
+typedef struct t_addon_chunk {
+  t_addon_batch  *batch;
+  size_t          first;
+  size_t          count;
+  int             err;
+  napi_async_work work;
+} t_addon_chunk;
+
+// throws a JS error for a failed N-API call, returns whether it succeeded
+static bool napi_ok_or_throw(napi_env env, napi_status status) {
+  if (status == napi_ok) return true;
+
+  bool pending;
+  if (napi_is_exception_pending(env, &pending) == napi_ok && !pending) {
+    const napi_extended_error_info *info = NULL;
+    napi_get_last_error_info(env, &info);
+    napi_throw_error(env, NULL, info && info->error_message? info->error_message : "N-API call failed.");
+  }
+  return false;
+}
+
+#define NAPI_CALL(env, call) if (!napi_ok_or_throw(env, (call))) return NULL
+
+static void *alloc_output(size_t size) {
+  return malloc(std::max(size, size_t(1)));
+}
+
+static void free_output(napi_env env, void *data, void *hint) {
+  free(data);
+}
+
+static void destroy_monitor(napi_env env, void *data, void *hint) {
+  switchres_monitor_destroy((t_switchres_monitor *)data);
+}
+
+static void free_batch(napi_env env, t_addon_batch *batch) {
+  if (batch->monitor_ref) napi_delete_reference(env, batch->monitor_ref);
+  if (batch->displays_ref) napi_delete_reference(env, batch->displays_ref);
+  free(batch->status);
+  free(batch->flags);
+  free(batch->modes);
+  delete batch;
+}
+
+// createMonitor(configJson: string)
+static napi_value create_monitor(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+
+  size_t length;
+  if (argc < 1 || napi_get_value_string_utf8(env, argv[0], NULL, 0, &length) != napi_ok) {
+    napi_throw_type_error(env, NULL, "The config must be a JSON string.");
+    return NULL;
+  }
+  std::string config_json(length, '\x00');
+  NAPI_CALL(env, napi_get_value_string_utf8(env, argv[0], &config_json[0], length + 1, &length));
+
+  t_switchres_monitor *monitor;
+  char err[256];
+  if (switchres_monitor_create(config_json.c_str(), &monitor, err, sizeof(err)) != SWITCHRES_OK) {
+    napi_throw_error(env, NULL, err);
+    return NULL;
+  }
+
+  napi_value external;
+  if (napi_create_external(env, monitor, destroy_monitor, NULL, &external) != napi_ok) {
+    switchres_monitor_destroy(monitor);
+    napi_ok_or_throw(env, napi_generic_failure);
+    return NULL;
+  }
+  return external;
+}
+
+static void execute_chunk(napi_env env, void *data) {
+  t_addon_chunk *chunk = (t_addon_chunk *)data;
+  t_addon_batch *batch = chunk->batch;
+
+  std::vector<t_switchres_display> displays(chunk->count);
+  std::vector<t_switchres_result> results(chunk->count);
+  for (size_t i = 0; i < chunk->count; ++i) {
+    const double *values = batch->displays + (chunk->first + i) * DISPLAY_FIELDS;
+    t_switchres_display *display = &displays[i];
+    display->type    = int(values[0]);
+    display->rotate  = int(values[1]);
+    display->flipx   = values[2] != 0;
+    display->width   = int(values[3]);
+    display->height  = int(values[4]);
+    display->refresh = values[5];
+  }
+
+  // already on a pool thread, the chunks are the parallelism
+  chunk->err = switchres_eval_batch(batch->monitor, displays.data(), chunk->count, results.data(), 1);
+  if (chunk->err != SWITCHRES_OK) return;
+
+  for (size_t i = 0; i < chunk->count; ++i) {
+    size_t index = chunk->first + i;
+    const t_switchres_result *result = &results[i];
+    const t_switchres_modeline *mode = &result->mode;
+    const double values[MODE_FIELDS] = {
+      double(mode->pclock), double(mode->hactive), double(mode->hbegin), double(mode->hend), double(mode->htotal),
+      double(mode->vactive), double(mode->vbegin), double(mode->vend), double(mode->vtotal),
+      double(mode->interlace), double(mode->doublescan), double(mode->hsync), double(mode->vsync),
+      mode->hfreq, mode->vfreq
+    };
+
+    batch->status[index] = result->status;
+    batch->flags[index] = result->flags;
+    memcpy(batch->modes + index * MODE_FIELDS, values, sizeof(values));
+    if (batch->with_text) {
+      batch->text[index] = result->text;
+    }
+  }
+}
+
+static napi_value create_batch_result(napi_env env, t_addon_batch *batch) {
+  napi_value result, buffer, array;
+  NAPI_CALL(env, napi_create_object(env, &result));
+
+  // once a buffer is external its memory belongs to it
+  NAPI_CALL(env, napi_create_external_arraybuffer(env, batch->status, batch->count * sizeof(int32_t), free_output, NULL, &buffer));
+  batch->status = NULL;
+  NAPI_CALL(env, napi_create_typedarray(env, napi_int32_array, batch->count, buffer, 0, &array));
+  NAPI_CALL(env, napi_set_named_property(env, result, "status", array));
+
+  NAPI_CALL(env, napi_create_external_arraybuffer(env, batch->flags, batch->count * sizeof(int32_t), free_output, NULL, &buffer));
+  batch->flags = NULL;
+  NAPI_CALL(env, napi_create_typedarray(env, napi_int32_array, batch->count, buffer, 0, &array));
+  NAPI_CALL(env, napi_set_named_property(env, result, "flags", array));
+
+  NAPI_CALL(env, napi_create_external_arraybuffer(env, batch->modes, batch->count * MODE_FIELDS * sizeof(double), free_output, NULL, &buffer));
+  batch->modes = NULL;
+  NAPI_CALL(env, napi_create_typedarray(env, napi_float64_array, batch->count * MODE_FIELDS, buffer, 0, &array));
+  NAPI_CALL(env, napi_set_named_property(env, result, "modes", array));
+
+  if (batch->with_text) {
+    NAPI_CALL(env, napi_create_array_with_length(env, batch->count, &array));
+    for (size_t i = 0; i < batch->count; ++i) {
+      napi_value str;
+      NAPI_CALL(env, napi_create_string_utf8(env, batch->text[i].c_str(), batch->text[i].size(), &str));
+      NAPI_CALL(env, napi_set_element(env, array, i, str));
+    }
+    NAPI_CALL(env, napi_set_named_property(env, result, "text", array));
+  }
+
+  return result;
+}
+
+static void reject_batch(napi_env env, t_addon_batch *batch, const char *message) {
+  napi_value msg, err;
+  napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &msg);
+  napi_create_error(env, NULL, msg, &err);
+  napi_reject_deferred(env, batch->deferred, err);
+}
+
+static void complete_chunk(napi_env env, napi_status status, void *data) {
+  t_addon_chunk *chunk = (t_addon_chunk *)data;
+  t_addon_batch *batch = chunk->batch;
+
+  if (status != napi_ok || chunk->err != SWITCHRES_OK) {
+    batch->failed = true;
+  }
+  if (chunk->work) napi_delete_async_work(env, chunk->work);
+  delete chunk;
+
+  if (--batch->pending) return;
+
+  if (batch->failed) {
+    reject_batch(env, batch, "Evaluating the batch failed.");
+  }
+  else {
+    napi_value result = create_batch_result(env, batch);
+    bool pending;
+    napi_is_exception_pending(env, &pending);
+    if (result && !pending) {
+      napi_resolve_deferred(env, batch->deferred, result);
+    }
+    else {
+      napi_value err;
+      if (pending) napi_get_and_clear_last_exception(env, &err);
+      reject_batch(env, batch, "Creating the batch result failed.");
+    }
+  }
+  free_batch(env, batch);
+}
+
+static bool get_option(napi_env env, napi_value options, const char *name, napi_value *value) {
+  napi_valuetype type;
+  bool has;
+  if (napi_typeof(env, options, &type) != napi_ok || type != napi_object) return false;
+  if (napi_has_named_property(env, options, name, &has) != napi_ok || !has) return false;
+  if (napi_get_named_property(env, options, name, value) != napi_ok) return false;
+  return napi_typeof(env, *value, &type) == napi_ok && type != napi_undefined;
+}
+
+// evalBatch(monitor, displays: Float64Array, options?: {chunks?: number, text?: boolean})
+static napi_value eval_batch(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+
+  void *monitor = NULL;
+  if (argc < 1 || napi_get_value_external(env, argv[0], &monitor) != napi_ok) {
+    napi_throw_type_error(env, NULL, "The monitor must be created by createMonitor.");
+    return NULL;
+  }
+
+  bool is_typedarray = false;
+  napi_typedarray_type array_type;
+  size_t length = 0;
+  void *displays = NULL;
+  if (argc >= 2) napi_is_typedarray(env, argv[1], &is_typedarray);
+  if (!is_typedarray) {
+    napi_throw_type_error(env, NULL, "The displays must be a Float64Array.");
+    return NULL;
+  }
+  NAPI_CALL(env, napi_get_typedarray_info(env, argv[1], &array_type, &length, &displays, NULL, NULL));
+  if (array_type != napi_float64_array || length % DISPLAY_FIELDS) {
+    napi_throw_type_error(env, NULL, "The displays must be a Float64Array of 6 values per display.");
+    return NULL;
+  }
+
+  // as many chunks as hardware threads, the pool size caps how many run at
+  // once
+  int chunks = int(std::thread::hardware_concurrency());
+  bool with_text = false;
+  napi_value option;
+  if (argc >= 3 && get_option(env, argv[2], "chunks", &option)) {
+    NAPI_CALL(env, napi_get_value_int32(env, option, &chunks));
+  }
+  if (argc >= 3 && get_option(env, argv[2], "text", &option)) {
+    NAPI_CALL(env, napi_get_value_bool(env, option, &with_text));
+  }
+
+  size_t count = length / DISPLAY_FIELDS;
+  size_t chunk_count = std::min(size_t(std::max(chunks, 1)), std::max(count, size_t(1)));
+
+  t_addon_batch *batch = new t_addon_batch;
+  batch->monitor      = (const t_switchres_monitor *)monitor;
+  batch->monitor_ref  = NULL;
+  batch->displays_ref = NULL;
+  batch->displays     = (const double *)displays;
+  batch->count        = count;
+  batch->with_text    = with_text;
+  batch->pending      = int(chunk_count);
+  batch->failed       = false;
+  batch->status       = (int32_t *)alloc_output(count * sizeof(int32_t));
+  batch->flags        = (int32_t *)alloc_output(count * sizeof(int32_t));
+  batch->modes        = (double *)alloc_output(count * MODE_FIELDS * sizeof(double));
+  if (with_text) batch->text.resize(count);
+
+  napi_value promise, resource_name;
+  if (
+    !batch->status || !batch->flags || !batch->modes ||
+    napi_create_reference(env, argv[0], 1, &batch->monitor_ref) != napi_ok ||
+    napi_create_reference(env, argv[1], 1, &batch->displays_ref) != napi_ok ||
+    napi_create_promise(env, &batch->deferred, &promise) != napi_ok ||
+    napi_create_string_utf8(env, "switchres.evalBatch", NAPI_AUTO_LENGTH, &resource_name) != napi_ok
+  ) {
+    free_batch(env, batch);
+    napi_ok_or_throw(env, napi_generic_failure);
+    return NULL;
+  }
+
+  // queued chunks complete (and free the batch with the last one) even if
+  // a later one fails to queue
+  size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+  for (size_t i = 0; i < chunk_count; ++i) {
+    t_addon_chunk *chunk = new t_addon_chunk;
+    chunk->batch = batch;
+    chunk->first = std::min(i * chunk_size, count);
+    chunk->count = std::min(chunk_size, count - chunk->first);
+    chunk->err   = SWITCHRES_OK;
+    chunk->work  = NULL;
+
+    if (napi_create_async_work(env, NULL, resource_name, execute_chunk, complete_chunk, chunk, &chunk->work) != napi_ok) {
+      chunk->work = NULL;
+    }
+    if (!chunk->work || napi_queue_async_work(env, chunk->work) != napi_ok) {
+      chunk->err = SWITCHRES_ERR_INTERNAL;
+      complete_chunk(env, napi_generic_failure, chunk);
+    }
+  }
+
+  return promise;
+}
+
+static napi_value init(napi_env env, napi_value exports) {
+  napi_property_descriptor properties[] = {
+    {"createMonitor", NULL, create_monitor, NULL, NULL, NULL, napi_default, NULL},
+    {"evalBatch",     NULL, eval_batch,     NULL, NULL, NULL, napi_default, NULL},
+  };
+  NAPI_CALL(env, napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties));
+
+  napi_value value, fields;
+  NAPI_CALL(env, napi_create_uint32(env, DISPLAY_FIELDS, &value));
+  NAPI_CALL(env, napi_set_named_property(env, exports, "DISPLAY_FIELDS", value));
+
+  NAPI_CALL(env, napi_create_array_with_length(env, MODE_FIELDS, &fields));
+  for (int i = 0; i < MODE_FIELDS; ++i) {
+    NAPI_CALL(env, napi_create_string_utf8(env, mode_field_names[i], NAPI_AUTO_LENGTH, &value));
+    NAPI_CALL(env, napi_set_element(env, fields, i, value));
+  }
+  NAPI_CALL(env, napi_set_named_property(env, exports, "modeFields", fields));
+
+  return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -0,0 +1,279 @@
+#include "compat_grid.h"
+#include <memory>
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string base64_encode(const std::vector<u8> &bytes) {
+  std::string str;
+  str.reserve((bytes.size() + 2) / 3 * 4);
+
+  for (size_t i = 0; i < bytes.size(); i += 3) {
+    u32 n = bytes[i] << 16;
+    if (i + 1 < bytes.size()) n |= bytes[i + 1] << 8;
+    if (i + 2 < bytes.size()) n |= bytes[i + 2];
+
+    str += base64_chars[(n >> 18) & 0x3f];
+    str += base64_chars[(n >> 12) & 0x3f];
+    str += i + 1 < bytes.size()? base64_chars[(n >> 6) & 0x3f] : '=';
+    str += i + 2 < bytes.size()? base64_chars[n & 0x3f] : '=';
+  }
+  return str;
+}
+
+static std::vector<u8> base64_decode(const std::string &str) {
+  std::vector<u8> bytes;
+  bytes.reserve(str.size() / 4 * 3);
+
+  u32 n = 0;
+  int bits = 0;
+  for (char c : str) {
+    const char *pos = strchr(base64_chars, c);
+    if (c == '=' || !c || !pos) continue;
+
+    n = (n << 6) | u32(pos - base64_chars);
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      bytes.push_back((n >> bits) & 0xff);
+    }
+  }
+  return bytes;
+}
+
+// most of a grid is a handful of repeating values, so cells are run-length
+// encoded as (count, value) pairs before being exported
+static std::vector<u8> rle_encode(const std::vector<u8> &cells) {
+  std::vector<u8> bytes;
+
+  for (size_t i = 0; i < cells.size();) {
+    size_t run = 1;
+    while (run < 255 && i + run < cells.size() && cells[i + run] == cells[i]) ++run;
+
+    bytes.push_back(u8(run));
+    bytes.push_back(cells[i]);
+    i += run;
+  }
+  return bytes;
+}
+
+static void rle_decode(const std::vector<u8> &bytes, std::vector<u8> &cells) {
+  size_t i = 0;
+  for (size_t j = 0; j + 1 < bytes.size(); j += 2) {
+    for (int k = 0; k < bytes[j]; ++k) {
+      if (i >= cells.size()) {
+        throw std::invalid_argument("Grid cells do not match the grid bounds.");
+      }
+      cells[i++] = bytes[j + 1];
+    }
+  }
+  if (i != cells.size()) {
+    throw std::invalid_argument("Grid cells do not match the grid bounds.");
+  }
+}
+
+compat_grid::compat_grid(const t_compat_grid_bounds *p_bounds)
+: bounds(*p_bounds)
+{
+  if (bounds.width_min < 1 || bounds.height_min < 1 || bounds.refresh_min < 1 ||
+      bounds.width_max < bounds.width_min || bounds.height_max < bounds.height_min || bounds.refresh_max < bounds.refresh_min) {
+    throw std::invalid_argument("Invalid grid bounds.");
+  }
+
+  // checked before the int sizes below can overflow
+  uint64_t max_cells =
+    uint64_t(2) *
+    (uint64_t(bounds.refresh_max) - bounds.refresh_min + 1) *
+    (uint64_t(bounds.height_max) - bounds.height_min + 1) *
+    ((uint64_t(bounds.width_max) - bounds.width_min) / 8 + 2);
+  if (max_cells > COMPAT_GRID_MAX_CELLS) {
+    throw std::invalid_argument("Grid bounds are too large.");
+  }
+
+  bucket_min = normalize(bounds.width_min, 8) / 8;
+  buckets    = normalize(bounds.width_max, 8) / 8 - bucket_min + 1;
+  heights    = bounds.height_max - bounds.height_min + 1;
+  refreshes  = int(bounds.refresh_max) - int(bounds.refresh_min) + 1;
+
+  cells.assign(size_t(2) * refreshes * heights * buckets, 0);
+  vector_cells.assign(size_t(2) * refreshes, 0);
+}
+
+u8 *compat_grid::cell(const t_display_key *key) {
+  if (key->refresh < bounds.refresh_min || key->refresh > bounds.refresh_max) {
+    return NULL;
+  }
+  int r = int(key->refresh - bounds.refresh_min);
+
+  if (key->vector) {
+    return &vector_cells[size_t(key->orientation) * refreshes + r];
+  }
+
+  int b = key->hactive / 8 - bucket_min;
+  int h = key->vactive - bounds.height_min;
+  if (b < 0 || b >= buckets || h < 0 || h >= heights) {
+    return NULL;
+  }
+  return &cells[((size_t(key->orientation) * refreshes + r) * heights + h) * buckets + b];
+}
+
+u8 pack_compat_cell(const modeline *best_mode) {
+  int range = best_mode->result.weight & R_OUT_OF_RANGE? COMPAT_CELL_NO_RANGE : best_mode->range;
+  return COMPAT_CELL_FILLED | ((range << 3) & COMPAT_CELL_RANGE_MASK) | (best_mode->result.weight & COMPAT_CELL_FLAGS_MASK);
+}
+
+json unpack_compat_cell(u8 cell) {
+  int range = (cell & COMPAT_CELL_RANGE_MASK) >> 3;
+  int flags = cell & COMPAT_CELL_FLAGS_MASK;
+
+  if (flags & R_OUT_OF_RANGE) {
+    return {
+      {"inRange", false}
+    };
+  }
+  return {
+    {"inRange",    true},
+    {"vfreqOff",   flags & R_V_FREQ_OFF ? true : false},
+    {"resStretch", flags & R_RES_STRETCH? true : false},
+    {"weight",     flags},
+    {"range",      range}
+  };
+}
+
+// evaluates the exact engine on a display that produces the given key
+u8 eval_compat_cell(const t_monitor_profile *profile, const t_display_key *key, t_eval_context *context) {
+  t_machine_display display;
+  display.type    = key->vector? SCREEN_TYPE_VECTOR : SCREEN_TYPE_RASTER;
+  display.refresh = key->refresh;
+  display.flipx   = false;
+
+  // the display is rotated if needed to reach the key's effective
+  // orientation (not every orientation is reachable with every monitor
+  // orientation option)
+  const int rotations[] = {0, 90};
+  for (int rotate : rotations) {
+    display.rotate = rotate;
+    display.width  = key->vector? 0 : (key->orientation? key->vactive : key->hactive);
+    display.height = key->vector? 0 : (key->orientation? key->hactive : key->vactive);
+
+    machine_instance instance(profile, "grid", &display);
+    t_display_key instance_key = instance.key();
+    if (instance_key.orientation != key->orientation) {
+      continue;
+    }
+
+    instance.search(context);
+    return pack_compat_cell(&instance.machine.switchres.best_mode);
+  }
+  return 0;
+}
+
+// fills the cells for the given keys, or every cell when no keys are given
+int fill_compat_grid(compat_grid *grid, const t_monitor_profile *profile, const std::vector<t_display_key> *keys, t_eval_context *context) {
+  int filled = 0;
+
+  if (keys) {
+    for (const t_display_key &key : *keys) {
+      u8 *cell = grid->cell(&key);
+      if (cell && !*cell) {
+        *cell = eval_compat_cell(profile, &key, context);
+        ++filled;
+      }
+    }
+    return filled;
+  }
+
+  t_display_key key;
+  for (int o = 0; o < 2; ++o) {
+    key.orientation = o;
+    for (u32 refresh = grid->bounds.refresh_min; refresh <= grid->bounds.refresh_max; ++refresh) {
+      key.refresh = refresh;
+
+      key.vector = true;
+      key.hactive = key.vactive = 1;
+      *grid->cell(&key) = eval_compat_cell(profile, &key, context);
+      ++filled;
+
+      key.vector = false;
+      for (int h = grid->bounds.height_min; h <= grid->bounds.height_max; ++h) {
+        key.vactive = h;
+        for (int b = 0; b < grid->buckets; ++b) {
+          key.hactive = (grid->bucket_min + b) * 8;
+          *grid->cell(&key) = eval_compat_cell(profile, &key, context);
+          ++filled;
+        }
+      }
+    }
+  }
+  return filled;
+}
+
+void get_compat_grid_bounds(const std::vector<t_display_key> &keys, t_compat_grid_bounds *bounds) {
+  bounds->width_min   = bounds->height_min  = bounds->refresh_min = 0;
+  bounds->width_max   = bounds->height_max  = bounds->refresh_max = 0;
+
+  bool first = true;
+  for (const t_display_key &key : keys) {
+    if (key.refresh < 1) continue;
+    if (first || key.refresh < bounds->refresh_min) bounds->refresh_min = key.refresh;
+    if (first || key.refresh > bounds->refresh_max) bounds->refresh_max = key.refresh;
+    first = false;
+  }
+
+  first = true;
+  for (const t_display_key &key : keys) {
+    if (key.vector || key.hactive < 1 || key.vactive < 1) continue;
+    if (first || key.hactive < bounds->width_min ) bounds->width_min  = key.hactive;
+    if (first || key.hactive > bounds->width_max ) bounds->width_max  = key.hactive;
+    if (first || key.vactive < bounds->height_min) bounds->height_min = key.vactive;
+    if (first || key.vactive > bounds->height_max) bounds->height_max = key.vactive;
+    first = false;
+  }
+
+  // keep the grid valid even if there are only vector displays
+  if (first) {
+    bounds->width_min = bounds->width_max = 8;
+    bounds->height_min = bounds->height_max = 1;
+  }
+}
+
+json export_compat_grid(compat_grid *grid, json &config) {
+  return {
+    {"version", COMPAT_GRID_VERSION},
+    {"config",  config},
+    {"bounds", {
+      {"widthMin",   grid->bounds.width_min  },
+      {"widthMax",   grid->bounds.width_max  },
+      {"heightMin",  grid->bounds.height_min },
+      {"heightMax",  grid->bounds.height_max },
+      {"refreshMin", grid->bounds.refresh_min},
+      {"refreshMax", grid->bounds.refresh_max}
+    }},
+    {"cells",       base64_encode(rle_encode(grid->cells       ))},
+    {"vectorCells", base64_encode(rle_encode(grid->vector_cells))}
+  };
+}
+
+compat_grid *import_compat_grid(json &grid_json, json &config) {
+  if (grid_json["version"].get<int>() != COMPAT_GRID_VERSION) {
+    throw std::invalid_argument("Unsupported grid version.");
+  }
+
+  // a grid is only valid for the monitor config it was built with
+  if (grid_json["config"] != config) {
+    throw std::invalid_argument("Grid was built for a different config.");
+  }
+
+  json bounds_json = grid_json["bounds"];
+  t_compat_grid_bounds bounds;
+  bounds.width_min   = bounds_json["widthMin"  ].get<int>();
+  bounds.width_max   = bounds_json["widthMax"  ].get<int>();
+  bounds.height_min  = bounds_json["heightMin" ].get<int>();
+  bounds.height_max  = bounds_json["heightMax" ].get<int>();
+  bounds.refresh_min = bounds_json["refreshMin"].get<u32>();
+  bounds.refresh_max = bounds_json["refreshMax"].get<u32>();
+
+  std::unique_ptr<compat_grid> grid(new compat_grid(&bounds));
+  rle_decode(base64_decode(grid_json["cells"      ].get<std::string>()), grid->cells);
+  rle_decode(base64_decode(grid_json["vectorCells"].get<std::string>()), grid->vector_cells);
+  return grid.release();
+}
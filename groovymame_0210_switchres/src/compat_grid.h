@@ -0,0 +1,62 @@
+#ifndef __COMPAT_GRID_H__
+#define __COMPAT_GRID_H__
+
+#include "engine.h"
+#include <vector>
+
+#define COMPAT_GRID_VERSION 1
+
+// packed cell: filled bit, range index (4 bits), result weight flags (3 bits)
+#define COMPAT_CELL_FILLED     0x80
+#define COMPAT_CELL_RANGE_MASK 0x78
+#define COMPAT_CELL_FLAGS_MASK 0x07
+#define COMPAT_CELL_NO_RANGE   0x0f
+
+// the most cells a grid can have (a byte each) and "fill": "all" can
+// evaluate in one request, larger bounds are an error
+#define COMPAT_GRID_MAX_CELLS (64 << 20)
+#define COMPAT_GRID_MAX_FILL  (1 << 20)
+
+typedef struct t_compat_grid_bounds {
+  int width_min;
+  int width_max;
+  int height_min;
+  int height_max;
+  u32 refresh_min;
+  u32 refresh_max;
+} t_compat_grid_bounds;
+
+// Dense per-profile table of the winning range and result flags for each
+// source mode MAME uses: width bucketed by 8 (like the source mode the
+// search uses), height, whole Hz refresh (all screen_device keeps) and
+// effective orientation. Vector displays only vary by refresh and
+// orientation so they get their own small table.
+class compat_grid {
+  public:
+    t_compat_grid_bounds bounds;
+    int bucket_min;
+    int buckets;
+    int heights;
+    int refreshes;
+    std::vector<u8> cells;
+    std::vector<u8> vector_cells;
+
+    compat_grid(const t_compat_grid_bounds *p_bounds);
+
+    // the cells fill_compat_grid evaluates without keys
+    size_t fill_size() const { return size() + vector_cells.size(); }
+
+    u8 *cell(const t_display_key *key);
+    size_t size() const { return cells.size(); }
+};
+
+std::string base64_encode(const std::vector<u8> &bytes);
+u8 pack_compat_cell(const modeline *best_mode);
+json unpack_compat_cell(u8 cell);
+u8 eval_compat_cell(const t_monitor_profile *profile, const t_display_key *key, t_eval_context *context);
+int fill_compat_grid(compat_grid *grid, const t_monitor_profile *profile, const std::vector<t_display_key> *keys, t_eval_context *context);
+void get_compat_grid_bounds(const std::vector<t_display_key> &keys, t_compat_grid_bounds *bounds);
+json export_compat_grid(compat_grid *grid, json &config);
+compat_grid *import_compat_grid(json &grid_json, json &config);
+
+#endif // __COMPAT_GRID_H__
@@ -0,0 +1,124 @@
+#include "compat_matrix.h"
+#include "compat_grid.h"
+#include "default_results.h"
+#include "parallel.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+
+#define MATRIX_CHUNK_SIZE 64
+
+// returns the key set for the profile's orientation option, computing it
+// the first time the option is seen
+int get_matrix_key_set(std::vector<t_matrix_key_set> &key_sets, const t_monitor_profile *profile, const std::vector<std::vector<t_machine_display>> &displays, const std::vector<bool> &decoded) {
+  for (size_t i = 0; i < key_sets.size(); ++i) {
+    if (key_sets[i].orientation == profile->config.orientation) {
+      return i;
+    }
+  }
+
+  key_sets.push_back(t_matrix_key_set());
+  t_matrix_key_set *key_set = &key_sets.back();
+  key_set->orientation = profile->config.orientation;
+  key_set->machine_keys.resize(displays.size());
+
+  std::map<t_display_key, int> key_indexes;
+  for (size_t i = 0; i < displays.size(); ++i) {
+    if (!decoded[i]) continue;
+
+    try {
+      std::vector<int> machine_keys;
+      for (const t_machine_display &display : displays[i]) {
+        machine_instance instance(profile, "", &display);
+        t_display_key key = instance.key();
+
+        std::map<t_display_key, int>::iterator it = key_indexes.find(key);
+        if (it == key_indexes.end()) {
+          it = key_indexes.insert(std::make_pair(key, int(key_set->keys.size()))).first;
+          key_set->keys.push_back(key);
+          key_set->displays.push_back(display);
+        }
+        machine_keys.push_back(it->second);
+      }
+      key_set->machine_keys[i] = machine_keys;
+    } catch(const std::exception& err) {}
+  }
+  return key_sets.size() - 1;
+}
+
+static u8 eval_matrix_cell(const t_matrix_monitor *monitor, const t_machine_display *display, t_eval_context *context) {
+  try {
+    machine_instance instance(&monitor->profile, "", display);
+
+    t_display_key key = instance.key();
+    const modeline *default_mode = monitor->default_results >= 0? lookup_default_result(monitor->default_results, &key) : NULL;
+    if (default_mode) {
+      return pack_compat_cell(default_mode);
+    }
+
+    instance.search(context);
+    return pack_compat_cell(&instance.machine.switchres.best_mode);
+  } catch(const std::exception& err) {
+    return 0;
+  }
+}
+
+// Evaluates every unique key of every valid monitor. The work is split in
+// chunks of keys of a single monitor so each worker only has to reset its
+// line params cache when it moves on to another monitor.
+void fill_compat_matrix(std::vector<t_matrix_monitor> &monitors, const std::vector<t_matrix_key_set> &key_sets, int workers) {
+  std::vector<std::pair<int, size_t>> chunks;
+  for (size_t m = 0; m < monitors.size(); ++m) {
+    if (!monitors[m].err.empty()) continue;
+
+    size_t keys = key_sets[monitors[m].key_set].keys.size();
+    monitors[m].key_cells.assign(keys, 0);
+    for (size_t begin = 0; begin < keys; begin += MATRIX_CHUNK_SIZE) {
+      chunks.push_back(std::make_pair(int(m), begin));
+    }
+  }
+
+  workers = parallel_workers(workers);
+  std::vector<std::unique_ptr<t_eval_context>> contexts;
+  std::vector<int> context_monitors(workers, -1);
+  for (int i = 0; i < workers; ++i) {
+    contexts.push_back(std::unique_ptr<t_eval_context>(create_eval_context()));
+  }
+
+  parallel_for(chunks.size(), workers, [&](size_t chunk, int worker) {
+    int m = chunks[chunk].first;
+    t_matrix_monitor *monitor = &monitors[m];
+    const t_matrix_key_set *key_set = &key_sets[monitor->key_set];
+    t_eval_context *context = contexts[worker].get();
+
+    if (context_monitors[worker] != m) {
+      line_params_cache_reset(&context->line_cache);
+      context_monitors[worker] = m;
+    }
+
+    size_t end = std::min(chunks[chunk].second + MATRIX_CHUNK_SIZE, key_set->keys.size());
+    for (size_t k = chunks[chunk].second; k < end; ++k) {
+      monitor->key_cells[k] = eval_matrix_cell(monitor, &key_set->displays[k], context);
+    }
+  });
+
+  for (std::unique_ptr<t_eval_context> &context : contexts) {
+    show_eval_context(context.get());
+  }
+}
+
+// the cell of the machine's worst screen, as in calc_modeline, or 0 if any
+// of its screens failed
+u8 get_matrix_cell(const t_matrix_monitor *monitor, const t_matrix_key_set *key_set, size_t machine) {
+  const std::vector<int> &machine_keys = key_set->machine_keys[machine];
+
+  u8 worst = 0;
+  for (size_t i = 0; i < machine_keys.size(); ++i) {
+    u8 cell = monitor->key_cells[machine_keys[i]];
+    if (!cell) return 0;
+    if (!i || (cell & COMPAT_CELL_FLAGS_MASK) > (worst & COMPAT_CELL_FLAGS_MASK)) {
+      worst = cell;
+    }
+  }
+  return worst;
+}
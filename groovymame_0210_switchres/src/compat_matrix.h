@@ -0,0 +1,33 @@
+#ifndef __COMPAT_MATRIX_H__
+#define __COMPAT_MATRIX_H__
+
+#include "engine.h"
+#include <string>
+#include <vector>
+
+// The unique display keys of a machine list for one monitor orientation
+// option, which is the only part of a profile the keys depend on. Monitors
+// with the same orientation option share a key set.
+typedef struct t_matrix_key_set {
+  std::string                    orientation;
+  std::vector<t_display_key>     keys;
+  std::vector<t_machine_display> displays;     // a display producing each key
+  std::vector<std::vector<int>>  machine_keys; // key index per screen of each machine, empty if it failed
+} t_matrix_key_set;
+
+// one column of the matrix, cells are packed like the compat grid cells
+// (0 if the evaluation failed)
+typedef struct t_matrix_monitor {
+  json              config;
+  std::string       err;
+  t_monitor_profile profile;
+  int               default_results;
+  int               key_set;
+  std::vector<u8>   key_cells;
+} t_matrix_monitor;
+
+int get_matrix_key_set(std::vector<t_matrix_key_set> &key_sets, const t_monitor_profile *profile, const std::vector<std::vector<t_machine_display>> &displays, const std::vector<bool> &decoded);
+void fill_compat_matrix(std::vector<t_matrix_monitor> &monitors, const std::vector<t_matrix_key_set> &key_sets, int workers);
+u8 get_matrix_cell(const t_matrix_monitor *monitor, const t_matrix_key_set *key_set, size_t machine);
+
+#endif // __COMPAT_MATRIX_H__
@@ -0,0 +1,267 @@
+#include "default_results.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+
+#define DEFAULT_RESULT_NONE 0xffff
+
+// the makefile defines it as the checksum of the engine sources, a table
+// generated from other sources is never used
+#ifndef SWITCHRES_ENGINE_HASH
+#define SWITCHRES_ENGINE_HASH 0
+#endif
+
+static const char *const default_result_orientations[] = {"horizontal", "vertical"};
+
+// generated by `make default-results`
+#include "default_results.inc"
+
+static bool operator<(const t_default_result_key &a, const t_default_result_key &b) {
+  if (a.flags   != b.flags  ) return a.flags   < b.flags;
+  if (a.hactive != b.hactive) return a.hactive < b.hactive;
+  if (a.vactive != b.vactive) return a.vactive < b.vactive;
+  return a.refresh < b.refresh;
+}
+
+static bool pack_default_result_key(const t_display_key *key, t_default_result_key *packed) {
+  if (
+    key->hactive < 0 || key->hactive > 0xffff ||
+    key->vactive < 0 || key->vactive > 0xffff ||
+    key->refresh > 0xffff
+  ) {
+    return false;
+  }
+
+  packed->hactive = key->hactive;
+  packed->vactive = key->vactive;
+  packed->refresh = key->refresh;
+  packed->flags   = (key->orientation? DEFAULT_RESULT_ORIENTATION : 0) | (key->vector? DEFAULT_RESULT_VECTOR : 0);
+  return true;
+}
+
+// the embedded results only apply to a built-in preset with default options
+// and no video mode table, and only if they were generated by this engine
+int find_default_results(const t_monitor_profile *profile) {
+  if (
+    !SWITCHRES_ENGINE_HASH || default_results_engine_hash != u32(SWITCHRES_ENGINE_HASH) ||
+    !has_default_options(&profile->config) || profile->mode_index.count
+  ) {
+    return -1;
+  }
+
+  // switchres treats an unset orientation as horizontal
+  const char *orientation = profile->config.orientation[0]? profile->config.orientation : "horizontal";
+
+  for (u32 i = 0; i < default_result_profile_count; ++i) {
+    const t_default_result_profile *result_profile = &default_result_profiles[i];
+    if (
+      !strcmp(result_profile->preset, profile->cs.monitor) &&
+      !strcmp(default_result_orientations[result_profile->orientation], orientation)
+    ) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const modeline *lookup_default_result(int profile_index, const t_display_key *key) {
+  const t_default_result_profile *result_profile = &default_result_profiles[profile_index];
+
+  t_default_result_key packed;
+  if (!pack_default_result_key(key, &packed)) {
+    return NULL;
+  }
+
+  const t_default_result_key *keys = default_result_keys[result_profile->orientation];
+  const t_default_result_key *keys_end = keys + default_result_key_counts[result_profile->orientation];
+  const t_default_result_key *it = std::lower_bound(keys, keys_end, packed);
+  if (it == keys_end || packed < *it) {
+    return NULL;
+  }
+
+  u16 mode_index = default_result_indexes[result_profile->indexes_offset + (it - keys)];
+  if (mode_index == DEFAULT_RESULT_NONE) {
+    return NULL;
+  }
+  return &default_result_modes[mode_index];
+}
+
+
+// writes a modeline as an aggregate initializer. Values are printed with
+// enough digits to be read back exactly.
+static bool print_modeline_initializer(const modeline *mode, std::string &str) {
+  const float result_floats[] = {
+    mode->result.x_diff, mode->result.y_diff, mode->result.v_diff,
+    mode->result.x_ratio, mode->result.y_ratio, mode->result.v_ratio
+  };
+  for (float value : result_floats) {
+    if (!std::isfinite(value)) return false;
+  }
+  if (!std::isfinite(mode->vfreq) || !std::isfinite(mode->hfreq)) return false;
+
+  char buf[1024] = {'\x00'};
+  sprintf(buf,
+    "{%lluULL, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %.17g, %.17g, %d, %d, %d, %d, %d, %d, "
+    "{%d, %d, %d, %d, %.17g, %.17g, %.17g, %.17g, %.17g, %.17g, %s}}",
+    (unsigned long long)mode->pclock,
+    mode->hactive, mode->hbegin, mode->hend, mode->htotal,
+    mode->vactive, mode->vbegin, mode->vend, mode->vtotal,
+    mode->interlace, mode->doublescan, mode->hsync, mode->vsync,
+    mode->vfreq, mode->hfreq,
+    mode->width, mode->height, mode->refresh, mode->refresh_label,
+    mode->type, mode->range,
+    mode->result.weight, mode->result.x_scale, mode->result.y_scale, mode->result.v_scale,
+    mode->result.x_diff, mode->result.y_diff, mode->result.v_diff,
+    mode->result.x_ratio, mode->result.y_ratio, mode->result.v_ratio,
+    mode->result.rotated? "true" : "false"
+  );
+  str = buf;
+  return true;
+}
+
+// Evaluates every display of the corpus for every built-in preset and both
+// monitor orientations and returns the results as C++ source for
+// default_results.inc
+std::string generate_default_results(json &corpus) {
+  std::vector<json> machines = (corpus.is_array()? corpus : corpus["machines"]).get<std::vector<json>>();
+
+  std::vector<t_default_result_key> keys[2];
+  std::vector<t_machine_display> key_displays[2];
+  std::vector<u16> indexes;
+  std::vector<std::string> modes;
+  std::map<std::string, u16> mode_indexes;
+  std::map<std::vector<u16>, u32> profile_offsets;
+  std::ostringstream profiles_src;
+  u32 profile_count = 0;
+
+  std::unique_ptr<t_eval_context> context(create_eval_context());
+  std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile);
+
+  for (int o = 0; o < 2; ++o) {
+    // the keys only depend on the orientation, any preset will do
+    t_monitor_config monitor_config;
+    json config = {
+      {"preset",      monitor_presets[0]},
+      {"orientation", default_result_orientations[o]}
+    };
+    parse_monitor_config(config, &monitor_config);
+    build_monitor_profile(&monitor_config, profile.get());
+
+    // one representative display per key as every display with the same key
+    // gets the same mode
+    std::map<t_default_result_key, t_machine_display> displays;
+    for (json &machine : machines) {
+      json displays_json = machine["displays"];
+      if (displays_json.is_null()) {
+        displays_json = json::array({machine["display"]});
+      }
+
+      for (json &machine_display : displays_json) {
+        try {
+          t_machine_display display;
+          parse_machine_display(machine_display, &display);
+
+          // screen_device can't represent a refresh below 1Hz
+          if (u32(display.refresh) < 1) continue;
+
+          machine_instance instance(profile.get(), "", &display);
+          t_display_key key = instance.key();
+
+          t_default_result_key packed;
+          if (pack_default_result_key(&key, &packed) && !displays.count(packed)) {
+            displays[packed] = display;
+          }
+        } catch(const std::exception& err) {}
+      }
+    }
+
+    for (std::map<t_default_result_key, t_machine_display>::iterator it = displays.begin(); it != displays.end(); ++it) {
+      keys[o].push_back(it->first);
+      key_displays[o].push_back(it->second);
+    }
+  }
+
+  bool has_keys = !keys[0].empty() || !keys[1].empty();
+  for (int p = 0; has_keys && p < monitor_preset_count; ++p) {
+    for (int o = 0; o < 2; ++o) {
+      t_monitor_config monitor_config;
+      json config = {
+        {"preset",      monitor_presets[p]},
+        {"orientation", default_result_orientations[o]}
+      };
+      parse_monitor_config(config, &monitor_config);
+      build_monitor_profile(&monitor_config, profile.get());
+      line_params_cache_reset(&context->line_cache);
+
+      std::vector<u16> profile_indexes;
+      for (t_machine_display &display : key_displays[o]) {
+        machine_instance instance(profile.get(), "", &display);
+        instance.search(context.get());
+
+        std::string mode_str;
+        u16 mode_index = DEFAULT_RESULT_NONE;
+        if (print_modeline_initializer(&instance.machine.switchres.best_mode, mode_str)) {
+          std::map<std::string, u16>::iterator it = mode_indexes.find(mode_str);
+          if (it != mode_indexes.end()) {
+            mode_index = it->second;
+          }
+          else if (modes.size() < DEFAULT_RESULT_NONE) {
+            mode_index = modes.size();
+            mode_indexes[mode_str] = mode_index;
+            modes.push_back(mode_str);
+          }
+        }
+        profile_indexes.push_back(mode_index);
+      }
+
+      // presets that are aliases (or just happen to agree) share indexes
+      std::map<std::vector<u16>, u32>::iterator it = profile_offsets.find(profile_indexes);
+      u32 offset;
+      if (it != profile_offsets.end()) {
+        offset = it->second;
+      }
+      else {
+        offset = indexes.size();
+        profile_offsets[profile_indexes] = offset;
+        indexes.insert(indexes.end(), profile_indexes.begin(), profile_indexes.end());
+      }
+
+      profiles_src << "  {\"" << monitor_presets[p] << "\", " << o << ", " << offset << "},\n";
+      ++profile_count;
+    }
+  }
+
+  std::ostringstream src;
+  src << "// generated by `make default-results`, do not edit\n\n";
+  src << "static const u32 default_results_engine_hash = " << u32(SWITCHRES_ENGINE_HASH) << ";\n\n";
+
+  for (int o = 0; o < 2; ++o) {
+    src << "static const t_default_result_key default_result_keys_" << o << "[] = {\n";
+    for (t_default_result_key &key : keys[o]) {
+      src << "  {" << key.hactive << ", " << key.vactive << ", " << key.refresh << ", " << int(key.flags) << "},\n";
+    }
+    src << "  {0, 0, 0, 0}\n};\n";
+  }
+  src << "static const t_default_result_key *const default_result_keys[] = {default_result_keys_0, default_result_keys_1};\n";
+  src << "static const u32 default_result_key_counts[] = {" << keys[0].size() << ", " << keys[1].size() << "};\n\n";
+
+  src << "static const t_default_result_profile default_result_profiles[] = {\n" << profiles_src.str() << "  {\"\", 0, 0}\n};\n";
+  src << "static const u32 default_result_profile_count = " << profile_count << ";\n\n";
+
+  src << "static const u16 default_result_indexes[] = {";
+  for (size_t i = 0; i < indexes.size(); ++i) {
+    src << (i % 16? " " : "\n  ") << indexes[i] << ",";
+  }
+  src << "\n  0\n};\n\n";
+
+  src << "static const modeline default_result_modes[] = {\n";
+  for (std::string &mode : modes) {
+    src << "  " << mode << ",\n";
+  }
+  src << "  {}\n};\n";
+
+  return src.str();
+}
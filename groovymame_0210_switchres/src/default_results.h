@@ -0,0 +1,34 @@
+#ifndef __DEFAULT_RESULTS_H__
+#define __DEFAULT_RESULTS_H__
+
+#include "engine.h"
+
+#define DEFAULT_RESULT_ORIENTATION 0x01
+#define DEFAULT_RESULT_VECTOR      0x02
+
+// Results for the built-in presets with default options, computed offline
+// over the machine display corpus (see `make default-results`) and compiled
+// into the module so the default config doesn't have to run the engine.
+//
+// The display keys only depend on the monitor orientation option, so there
+// is one sorted key set per orientation shared by every preset. Each
+// profile has a mode index per key into the deduplicated mode pool, and
+// profiles with identical results share their indexes.
+typedef struct t_default_result_key {
+  u16 hactive;
+  u16 vactive;
+  u16 refresh;
+  u8  flags;
+} t_default_result_key;
+
+typedef struct t_default_result_profile {
+  const char *preset;
+  int         orientation;
+  u32         indexes_offset;
+} t_default_result_profile;
+
+int find_default_results(const t_monitor_profile *profile);
+const modeline *lookup_default_result(int profile_index, const t_display_key *key);
+std::string generate_default_results(json &corpus);
+
+#endif // __DEFAULT_RESULTS_H__
@@ -0,0 +1,523 @@
+#include "engine.h"
+#include "switchres_proto.h"
+#include "video_modes.h"
+
+void copy_json_str(std::string str, char* dest) {
+  // not sure why this is necessary
+  strcpy(dest, str.c_str());
+}
+
+u32 get_machine_flags(const t_machine_display *display) {
+  return (
+    machine_flags::TYPE_ARCADE | (
+      (
+        display->rotate ==  90? machine_flags::ROT90  :
+        display->rotate == 180? machine_flags::ROT180 :
+        display->rotate == 270? machine_flags::ROT180 :
+        0
+      )
+      ^ (display->flipx? machine_flags::FLIP_X : 0)
+    )
+  );
+}
+
+json get_machine_display_json(json &machine) {
+  json machine_display = machine["display"];
+
+  if (machine_display.is_null()) {
+    machine_display = machine["displays"].get<std::vector<json>>().front();
+  }
+  return machine_display;
+}
+
+// every display of the machine, in order
+std::vector<json> get_machine_displays_json(json &machine) {
+  json machine_display = machine["display"];
+
+  if (machine_display.is_null()) {
+    return machine["displays"].get<std::vector<json>>();
+  }
+  return std::vector<json>(1, machine_display);
+}
+
+bool operator==(const t_machine_display &a, const t_machine_display &b) {
+  return (
+    a.type    == b.type    &&
+    a.refresh == b.refresh &&
+    a.width   == b.width   &&
+    a.height  == b.height  &&
+    a.rotate  == b.rotate  &&
+    a.flipx   == b.flipx
+  );
+}
+
+void parse_machine_display(json &machine_display, t_machine_display *display) {
+  char screen_type_str[256] = {'\x00'};
+  copy_json_str(machine_display["type"].get<std::string>(), screen_type_str);
+
+  if (!strcmp(screen_type_str, "raster")) {
+    display->type = SCREEN_TYPE_RASTER;
+  }
+  else if (!strcmp(screen_type_str, "vector")) {
+    display->type = SCREEN_TYPE_VECTOR;
+  }
+  else if (!strcmp(screen_type_str, "lcd")) {
+    display->type = SCREEN_TYPE_LCD;
+  }
+  else if (!strcmp(screen_type_str, "svg")) {
+    display->type = SCREEN_TYPE_SVG;
+  }
+  else {
+    display->type = SCREEN_TYPE_INVALID;
+  }
+
+  display->refresh = machine_display["refresh"].get<double>();
+
+  display->width = display->height = 0;
+  if (display->type != SCREEN_TYPE_VECTOR) {
+    display->width  = machine_display["width"].get<s32>();
+    display->height = machine_display["height"].get<s32>();
+  }
+
+  /*
+  screen.set_raw(
+    machine_display["pixclock"].get<u32>(),
+    machine_display["htotal"  ].get<u16>(),
+    machine_display["hbend"   ].get<u16>(),
+    machine_display["hbstart" ].get<u16>(),
+    machine_display["vtotal"  ].get<u16>(),
+    machine_display["vbend"   ].get<u16>(),
+    machine_display["vbstart" ].get<u16>()
+  );
+  */
+
+  display->rotate = machine_display["rotate"].get<int>();
+  display->flipx  = machine_display["flipx"].get<bool>();
+}
+
+void parse_monitor_config(json &config, t_monitor_config *monitor_config) {
+  memset(monitor_config, 0, sizeof(t_monitor_config));
+  monitor_config->allow_interlaced = true;
+  monitor_config->allow_doublescan = true;
+  monitor_config->super_width = 2560;
+  strcpy(monitor_config->dotclock_min, "0");
+  strcpy(monitor_config->sync_refresh_tolerance, "2.0");
+  monitor_config->lock_system_modes = true;
+  strcpy(monitor_config->modeline, "auto");
+
+  json monitor_orientation_json = config["orientation"];
+  if (!monitor_orientation_json.is_null()) {
+    copy_json_str(monitor_orientation_json.get<std::string>(), monitor_config->orientation);
+  }
+
+  json monitor_preset_json = config["preset"];
+  if (!monitor_preset_json.is_null()) {
+    copy_json_str(monitor_preset_json.get<std::string>(), monitor_config->monitor);
+  }
+  json monitor_ranges_json = config["ranges"];
+  if (!monitor_ranges_json.is_null()) {
+    std::vector<std::string> monitor_ranges_str = monitor_ranges_json.get<std::vector<std::string>>();
+
+    int i;
+    std::vector<std::string>::iterator it;
+    for (
+      i = 0,    it = monitor_ranges_str.begin();
+      i < 10 && it != monitor_ranges_str.end();
+      ++i,      ++it
+    ) {
+      it->resize(MAX_RANGE_LEN-1);
+      strcpy(monitor_config->ranges[i], it->c_str());
+    }
+  }
+
+  json allow_interlaced_json = config["allowInterlaced"];
+  if (!allow_interlaced_json.is_null()) {
+    monitor_config->allow_interlaced = allow_interlaced_json.get<bool>();
+  }
+
+  json allow_doublescan_json = config["allowDoublescan"];
+  if (!allow_doublescan_json.is_null()) {
+    monitor_config->allow_doublescan = allow_doublescan_json.get<bool>();
+  }
+
+  json super_width_json = config["superWidth"];
+  if (!super_width_json.is_null()) {
+    monitor_config->super_width = super_width_json.get<int>();
+  }
+
+  // SwitchRes reads these as strings
+  json dotclock_min_json = config["dotclockMin"];
+  if (!dotclock_min_json.is_null()) {
+    sprintf(monitor_config->dotclock_min, "%.17g", dotclock_min_json.get<double>());
+  }
+
+  json sync_refresh_tolerance_json = config["syncRefreshTolerance"];
+  if (!sync_refresh_tolerance_json.is_null()) {
+    sprintf(monitor_config->sync_refresh_tolerance, "%.17g", sync_refresh_tolerance_json.get<double>());
+  }
+
+  json lock_system_modes_json = config["lockSystemModes"];
+  if (!lock_system_modes_json.is_null()) {
+    monitor_config->lock_system_modes = lock_system_modes_json.get<bool>();
+  }
+
+  json modeline_json = config["modeline"];
+  if (!modeline_json.is_null()) {
+    std::string modeline_str = modeline_json.get<std::string>();
+    if (modeline_str.size() >= sizeof(monitor_config->modeline)) {
+      throw std::invalid_argument("Modeline is too long.");
+    }
+    copy_json_str(modeline_str, monitor_config->modeline);
+  }
+}
+
+// whether every option is left at the value parse_monitor_config defaults to
+bool has_default_options(const t_monitor_config *monitor_config) {
+  t_monitor_config defaults;
+  json empty_config = json::object();
+  parse_monitor_config(empty_config, &defaults);
+
+  return (
+    monitor_config->allow_interlaced == defaults.allow_interlaced &&
+    monitor_config->allow_doublescan == defaults.allow_doublescan &&
+    monitor_config->super_width      == defaults.super_width      &&
+    !strcmp(monitor_config->dotclock_min, defaults.dotclock_min)  &&
+    !strcmp(monitor_config->sync_refresh_tolerance, defaults.sync_refresh_tolerance) &&
+    monitor_config->lock_system_modes == defaults.lock_system_modes &&
+    !strcmp(monitor_config->modeline, defaults.modeline)
+  );
+}
+
+void apply_monitor_config(const t_monitor_config *monitor_config, emu_options *options) {
+  strcpy(options->m_orientation, monitor_config->orientation);
+  strcpy(options->m_monitor, monitor_config->monitor);
+  memcpy(options->m_ranges, monitor_config->ranges, sizeof(monitor_config->ranges));
+  options->m_allow_interlaced = monitor_config->allow_interlaced;
+  options->m_allow_doublescan = monitor_config->allow_doublescan;
+  options->m_super_width = monitor_config->super_width;
+  strcpy(options->m_dotclock_min, monitor_config->dotclock_min);
+  strcpy(options->m_sync_refresh_tolerance, monitor_config->sync_refresh_tolerance);
+  options->m_lock_system_modes = monitor_config->lock_system_modes;
+  strcpy(options->m_modeline, monitor_config->modeline);
+}
+
+void build_monitor_profile(const t_monitor_config *monitor_config, t_monitor_profile *profile) {
+  memset(profile, 0, sizeof(t_monitor_profile));
+  profile->config = *monitor_config;
+
+  screen_device screen = screen_device();
+  game_driver system = game_driver("", machine_flags::TYPE_ARCADE, &screen);
+  emu_options options = emu_options(&system);
+  apply_monitor_config(monitor_config, &options);
+
+  render_manager render = render_manager();
+  running_machine machine = running_machine(&system, &options, &render);
+  machine.switchres.cs.monitor_aspect = STANDARD_CRT_ASPECT;
+
+  // modeline_parse doesn't guard against every bad modeline
+  modeline user_mode;
+  if (strcmp(monitor_config->modeline, "auto") && !parse_modeline_fast(monitor_config->modeline, &user_mode, NULL)) {
+    throw std::invalid_argument("Invalid modeline.");
+  }
+
+  // throws if the monitor config is invalid
+  switchres_init(machine);
+
+  profile->cs = machine.switchres.cs;
+  memcpy(profile->range, machine.switchres.range, sizeof(profile->range));
+  profile->user_mode = machine.switchres.user_mode;
+
+  // the mode scan stops at a mode without width, modeline_parse leaves it
+  // to the OSD
+  profile->user_mode.width  = profile->user_mode.hactive;
+  profile->user_mode.height = profile->user_mode.vactive;
+}
+
+// the monitor profile of an input config, video modes included
+void build_monitor_profile(json &config, t_monitor_profile *profile) {
+  t_monitor_config monitor_config;
+  parse_monitor_config(config, &monitor_config);
+  build_monitor_profile(&monitor_config, profile);
+  load_video_modes(config, profile);
+}
+
+// replaces the profile's user modeline (and so its range) with an already
+// parsed one, like switchres_init does
+void set_user_modeline(t_monitor_profile *profile, const modeline *mode, const char *modeline_str) {
+  snprintf(profile->config.modeline, sizeof(profile->config.modeline), "%s", modeline_str);
+
+  profile->user_mode = *mode;
+  profile->user_mode.type |= MODE_USER_DEF;
+  profile->user_mode.width  = profile->user_mode.hactive;
+  profile->user_mode.height = profile->user_mode.vactive;
+  memset(profile->range, 0, sizeof(profile->range));
+  modeline_to_monitor_range(profile->range, &profile->user_mode);
+  index_video_modes(profile);
+}
+
+// Fills the profile's video mode table from the config's "videoModesFile"
+// (read natively) and "videoModes" (the list text or an array of its
+// lines), see video_modes.h
+void load_video_modes(json &config, t_monitor_profile *profile) {
+  int count = 0;
+  memset(profile->video_modes, 0, sizeof(profile->video_modes));
+
+  json video_modes_file_json = config["videoModesFile"];
+  if (!video_modes_file_json.is_null()) {
+    std::string text = read_video_modes_file(video_modes_file_json.get<std::string>().c_str());
+    count = parse_video_modes(text, profile->video_modes, count);
+  }
+
+  json video_modes_json = config["videoModes"];
+  if (video_modes_json.is_string()) {
+    count = parse_video_modes(video_modes_json.get<std::string>(), profile->video_modes, count);
+  }
+  else if (!video_modes_json.is_null()) {
+    std::string text;
+    for (const std::string &line : video_modes_json.get<std::vector<std::string>>()) {
+      text += line + "\n";
+    }
+    count = parse_video_modes(text, profile->video_modes, count);
+  }
+
+  index_video_modes(profile);
+}
+
+void index_video_modes(t_monitor_profile *profile) {
+  switchres_index_video_modes(&profile->cs, profile->range, profile->video_modes, &profile->mode_index);
+}
+
+machine_instance::machine_instance(const t_monitor_profile *profile, const char *machine_name, const t_machine_display *p_display)
+: display(*p_display),
+  screen(),
+  system(machine_name, get_machine_flags(p_display), &screen),
+  options(&system),
+  render(),
+  machine(&system, &options, &render)
+{
+  screen.set_type(display.type);
+  screen.set_refresh_hz(display.refresh);
+
+  if (screen.screen_type() != SCREEN_TYPE_VECTOR) {
+    screen.set_visarea(
+      0,
+      display.width-1,
+      0,
+      display.height-1
+    );
+  }
+
+  set_profile(profile);
+  switchres_get_game_info(machine);
+}
+
+// switches the instance to another profile. The game info is kept so the
+// profile must have the same orientation option.
+void machine_instance::set_profile(const t_monitor_profile *profile) {
+  apply_monitor_config(&profile->config, &options);
+
+  machine.switchres.cs = profile->cs;
+  memcpy(machine.switchres.range, profile->range, sizeof(machine.switchres.range));
+  machine.switchres.user_mode = profile->user_mode;
+
+  // the types get the options applied during the search, so every instance
+  // has its own copy of the modes (and the zeroed entry ending them)
+  int modes = std::min(profile->mode_index.count + 2, MAX_MODELINES);
+  memcpy(machine.switchres.video_modes, profile->video_modes, sizeof(modeline) * modes);
+  machine.switchres.mode_index = profile->mode_index.count? &profile->mode_index : NULL;
+}
+
+// changes the screen's resolution and refresh like a running machine would
+// and returns whether SwitchRes sees a resolution change
+bool machine_instance::set_state(double refresh, s32 width, s32 height) {
+  display.refresh = refresh;
+  screen.set_refresh_hz(display.refresh);
+
+  if (screen.screen_type() != SCREEN_TYPE_VECTOR) {
+    display.width  = width;
+    display.height = height;
+    screen.set_visarea(0, display.width-1, 0, display.height-1);
+  }
+
+  return switchres_check_resolution_change(machine);
+}
+
+t_display_key machine_instance::key() const {
+  const game_info *game = &machine.switchres.game;
+
+  t_display_key key;
+  key.vector      = game->vector;
+  key.hactive     = game->vector? 1 : normalize(game->width, 8);
+  key.vactive     = game->vector? 1 : game->height;
+  key.refresh     = u32(display.refresh); // screen_device keeps whole Hz only
+  key.orientation = game->orientation;
+  return key;
+}
+
+bool operator==(const t_display_key &a, const t_display_key &b) {
+  return (
+    a.hactive     == b.hactive     &&
+    a.vactive     == b.vactive     &&
+    a.refresh     == b.refresh     &&
+    a.orientation == b.orientation &&
+    a.vector      == b.vector
+  );
+}
+
+// whether switching from one mode to the other needs a mode change
+bool same_mode_timing(const modeline *a, const modeline *b) {
+  return (
+    a->pclock     == b->pclock     &&
+    a->hactive    == b->hactive    &&
+    a->hbegin     == b->hbegin     &&
+    a->hend       == b->hend       &&
+    a->htotal     == b->htotal     &&
+    a->vactive    == b->vactive    &&
+    a->vbegin     == b->vbegin     &&
+    a->vend       == b->vend       &&
+    a->vtotal     == b->vtotal     &&
+    a->interlace  == b->interlace  &&
+    a->doublescan == b->doublescan &&
+    a->hsync      == b->hsync      &&
+    a->vsync      == b->vsync
+  );
+}
+
+bool operator<(const t_display_key &a, const t_display_key &b) {
+  if (a.vector      != b.vector     ) return a.vector      < b.vector;
+  if (a.orientation != b.orientation) return a.orientation < b.orientation;
+  if (a.refresh     != b.refresh    ) return a.refresh     < b.refresh;
+  if (a.vactive     != b.vactive    ) return a.vactive     < b.vactive;
+  return a.hactive < b.hactive;
+}
+
+// a NULL context disables the memoization, for ranges that change between
+// searches
+void machine_instance::search(t_eval_context *context) {
+  int disabled = context? context->disabled : 0;
+  machine.switchres.cs.line_cache = context && !(disabled & EVAL_NO_LINE_CACHE)? &context->line_cache : NULL;
+  machine.switchres.cs.prefilter_stats = context? &context->prefilter : NULL;
+  machine.switchres.cs.search_stats = context && context->stats.enabled? &context->stats.search : NULL;
+  machine.switchres.cs.trace = context? context->trace : NULL;
+  machine.switchres.cs.disable_prefilter = disabled & EVAL_NO_PREFILTER;
+
+  // a user modeline is evaluated as is, otherwise the user mode is a fully
+  // editable dummy unless there's a mode table
+  modeline *mode = &machine.switchres.user_mode;
+  if ((mode->type & MODE_USER_DEF) && mode->hactive) {
+    switchres_get_video_mode(machine);
+    return;
+  }
+  if (machine.switchres.mode_index) {
+    memset(mode, 0, sizeof(modeline));
+
+    // without the index the table is scanned in order
+    const video_mode_index *mode_index = machine.switchres.mode_index;
+    if (disabled & EVAL_NO_MODE_INDEX) machine.switchres.mode_index = NULL;
+    switchres_get_video_mode(machine);
+    machine.switchres.mode_index = mode_index;
+    return;
+  }
+
+  mode->width = mode->height = 1;
+  mode->refresh = 60;
+  mode->vfreq = mode->refresh;
+  mode->hactive = mode->vactive = 1;
+  mode->type = XYV_EDITABLE | XRANDR_TIMING | (machine.switchres.cs.desktop_rotated? MODE_ROTATED : MODE_OK);
+
+  char modeline_txt[256]={'\x00'};
+  osd_printf_verbose("SwitchRes: user modeline %s\n", modeline_print(mode, modeline_txt, MS_FULL));
+
+  switchres_get_video_mode(machine);
+}
+
+void machine_instance::get_result(t_machine_result *result) const {
+  result->game      = machine.switchres.game;
+  result->best_mode = machine.switchres.best_mode;
+}
+
+t_eval_context *create_eval_context() {
+  t_eval_context *context = new t_eval_context;
+  line_params_cache_reset(&context->line_cache);
+  memset(&context->prefilter, 0, sizeof(context->prefilter));
+  eval_stats_reset(&context->stats, false, false);
+  context->tracer = NULL;
+  context->trace = NULL;
+  context->disabled = 0;
+  return context;
+}
+
+void show_eval_context(t_eval_context *context) {
+  line_params_cache_show(&context->line_cache);
+  prefilter_stats_show(&context->prefilter);
+}
+
+json serialize_machine_result(const t_machine_result *result) {
+  const game_info *game = &result->game;
+  modeline best_mode_copy = result->best_mode;
+  modeline *best_mode = &best_mode_copy;
+
+  if (best_mode->result.weight & R_OUT_OF_RANGE) {
+    return {
+      {"inRange", false},
+      {"description", "OUT OF RANGE"},
+      {"details", "OUT OF RANGE"},
+    };
+  }
+
+  char description[256] = {'\x00'};
+  sprintf(description, "%s (%dx%d@%.6f)->(%dx%d@%.6f)", game->orientation?"vertical":"horizontal",
+    game->width, game->height, game->refresh, best_mode->hactive, best_mode->vactive, best_mode->vfreq
+  );
+
+  char details[256] = {'\x00'};
+  modeline_result(best_mode, details);
+
+  char modeline_str[512] = {'\x00'};
+  modeline_print(best_mode, modeline_str, MS_LABEL | MS_PARAMS);
+
+  return {
+    {"inRange", true},
+    {"description", description},
+    {"details", details},
+    {"modelineStr", modeline_str},
+    {"vfreqOff",   best_mode->result.weight & R_V_FREQ_OFF ? true : false},
+    {"resStretch", best_mode->result.weight & R_RES_STRETCH? true : false},
+    {"weight",     best_mode->result.weight },
+    {"xScale",     best_mode->result.x_scale},
+    {"yScale",     best_mode->result.y_scale},
+    {"vScale",     best_mode->result.v_scale},
+    {"xDiff",      best_mode->result.x_diff },
+    {"yDiff",      best_mode->result.y_diff },
+    {"vDiff",      best_mode->result.v_diff },
+    {"xRatio",     best_mode->result.x_ratio},
+    {"yRatio",     best_mode->result.y_ratio},
+    {"vRatio",     best_mode->result.v_ratio},
+    {"rotated",    best_mode->result.rotated},
+    {"modeline", {
+      {"pclock",     best_mode->pclock    },
+      {"hactive",    best_mode->hactive   },
+      {"hbegin",     best_mode->hbegin    },
+      {"hend",       best_mode->hend      },
+      {"htotal",     best_mode->htotal    },
+      {"vactive",    best_mode->vactive   },
+      {"vbegin",     best_mode->vbegin    },
+      {"vend",       best_mode->vend      },
+      {"vtotal",     best_mode->vtotal    },
+      {"interlace",  best_mode->interlace },
+      {"doublescan", best_mode->doublescan},
+      {"hsync",      best_mode->hsync     },
+      {"vsync",      best_mode->vsync     },
+      //
+      {"vfreq",      best_mode->vfreq     },
+      {"hfreq",      best_mode->hfreq     },
+      //
+      {"width",      best_mode->width     },
+      {"height",     best_mode->height    },
+      {"refresh",    best_mode->refresh   },
+      //
+      {"type",       best_mode->type      },
+      {"range",      best_mode->range     }
+    }},
+  };
+}
@@ -0,0 +1,125 @@
+#ifndef __ENGINE_H__
+#define __ENGINE_H__
+
+#include "ext.h"
+#include "eval_stats.h"
+#include "trace_file.h"
+#include "../lib/json.hpp"
+
+using json = nlohmann::json;
+
+// a machine display as given in the input JSON
+typedef struct t_machine_display {
+  screen_type_enum type;
+  double refresh;
+  s32    width;
+  s32    height;
+  int    rotate;
+  bool   flipx;
+} t_machine_display;
+
+// the monitor part of the input config
+typedef struct t_monitor_config {
+  char orientation[256];
+  char monitor[256];
+  char ranges[MAX_RANGES][MAX_RANGE_LEN];
+  bool allow_interlaced;
+  bool allow_doublescan;
+  int  super_width;
+  char dotclock_min[32];
+  char sync_refresh_tolerance[32];
+  bool lock_system_modes;
+  char modeline[256];
+} t_monitor_config;
+
+// everything SwitchRes derives from the monitor config, built once and
+// copied into each machine instead of running switchres_init per machine.
+// With a user modeline the search only evaluates that mode (and the range
+// is derived from it), otherwise with a video mode table it evaluates the
+// table's modes instead of generating one. The table index must be rebuilt
+// when the ranges change.
+typedef struct t_monitor_profile {
+  t_monitor_config config;
+  config_settings  cs;
+  monitor_range    range[MAX_RANGES];
+  modeline         user_mode;
+  modeline         video_modes[MAX_MODELINES];
+  video_mode_index mode_index;
+} t_monitor_profile;
+
+// the inputs the mode search actually depends on for a given profile:
+// the source mode (normalized width, height, integer refresh) and the
+// effective orientation. Vector displays always use a 1x1 source mode.
+typedef struct t_display_key {
+  int  hactive;
+  int  vactive;
+  u32  refresh;
+  bool orientation;
+  bool vector;
+} t_display_key;
+
+bool operator==(const t_display_key &a, const t_display_key &b);
+bool same_mode_timing(const modeline *a, const modeline *b);
+bool operator<(const t_display_key &a, const t_display_key &b);
+
+// the optimizations a context can turn off, to check their results
+// against the plain engine
+#define EVAL_NO_LINE_CACHE      0x01
+#define EVAL_NO_PREFILTER       0x02
+#define EVAL_NO_MODE_INDEX      0x04
+#define EVAL_NO_DEFAULT_RESULTS 0x08
+
+// per batch (and later per worker) state shared by every search. With
+// tracing on the worker has a tracer and trace is its buffer while a traced
+// machine is being searched, NULL otherwise. disabled is a mask of EVAL_NO_*.
+typedef struct t_eval_context {
+  line_params_cache line_cache;
+  prefilter_stats   prefilter;
+  t_eval_stats      stats;
+  t_trace_thread   *tracer;
+  trace_buffer     *trace;
+  int               disabled;
+} t_eval_context;
+
+typedef struct t_machine_result {
+  game_info game;
+  modeline  best_mode;
+} t_machine_result;
+
+// a single machine set up against a monitor profile
+class machine_instance {
+  public:
+    t_machine_display display;
+    screen_device     screen;
+    game_driver       system;
+    emu_options       options;
+    render_manager    render;
+    running_machine   machine;
+
+    machine_instance(const t_monitor_profile *profile, const char *machine_name, const t_machine_display *p_display);
+
+    void set_profile(const t_monitor_profile *profile);
+    bool set_state(double refresh, s32 width, s32 height);
+    t_display_key key() const;
+    void search(t_eval_context *context);
+    void get_result(t_machine_result *result) const;
+};
+
+void copy_json_str(std::string str, char* dest);
+void parse_machine_display(json &machine_display, t_machine_display *display);
+json get_machine_display_json(json &machine);
+std::vector<json> get_machine_displays_json(json &machine);
+bool operator==(const t_machine_display &a, const t_machine_display &b);
+void parse_monitor_config(json &config, t_monitor_config *monitor_config);
+bool has_default_options(const t_monitor_config *monitor_config);
+void apply_monitor_config(const t_monitor_config *monitor_config, emu_options *options);
+void build_monitor_profile(const t_monitor_config *monitor_config, t_monitor_profile *profile);
+void build_monitor_profile(json &config, t_monitor_profile *profile);
+void load_video_modes(json &config, t_monitor_profile *profile);
+void index_video_modes(t_monitor_profile *profile);
+void set_user_modeline(t_monitor_profile *profile, const modeline *mode, const char *modeline_str);
+json serialize_machine_result(const t_machine_result *result);
+t_eval_context *create_eval_context();
+void show_eval_context(t_eval_context *context);
+
+#endif // __ENGINE_H__
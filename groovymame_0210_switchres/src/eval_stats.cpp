@@ -0,0 +1,160 @@
+#include "eval_stats.h"
+#include <chrono>
+#include <memory>
+
+#ifndef __wasm__
+#include <sys/resource.h>
+#endif
+
+static const char *const stage_names[STAGE_COUNT] = {
+  "parse", "monitor", "gameInfo", "search", "serialize"
+};
+
+// 1us to 10s, the Prometheus client defaults extended to the microseconds
+// a cached search takes
+const double latency_bucket_bounds[LATENCY_BUCKETS] = {
+  0.000001, 0.0000025, 0.000005, 0.00001, 0.000025, 0.00005,
+  0.0001,   0.00025,   0.0005,   0.001,   0.0025,   0.005,
+  0.01,     0.025,     0.05,     0.1,     0.25,     0.5,
+  1,        2.5,       5,        10
+};
+
+static void latency_hist_observe(t_latency_hist *hist, double ms) {
+  double seconds = ms / 1000;
+  int bucket = 0;
+  while (bucket < LATENCY_BUCKETS && seconds > latency_bucket_bounds[bucket]) {
+    ++bucket;
+  }
+  ++hist->buckets[bucket];
+  ++hist->count;
+  hist->sum_ms += ms;
+}
+
+static void latency_hist_merge(t_latency_hist *hist, const t_latency_hist *from) {
+  for (int i = 0; i <= LATENCY_BUCKETS; ++i) {
+    hist->buckets[i] += from->buckets[i];
+  }
+  hist->count += from->count;
+  hist->sum_ms += from->sum_ms;
+}
+
+static void latency_hist_serialize(std::string &out, const char *name, const char *labels, const t_latency_hist *hist) {
+  char line[256];
+  uint64_t cumulative = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+    cumulative += hist->buckets[i];
+    snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, *labels? "," : "", latency_bucket_bounds[i], (unsigned long long)cumulative);
+    out += line;
+  }
+  snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, *labels? "," : "", (unsigned long long)hist->count);
+  out += line;
+
+  const char *open = *labels? "{" : "";
+  const char *close = *labels? "}" : "";
+  snprintf(line, sizeof(line), "%s_sum%s%s%s %.9g\n", name, open, labels, close, hist->sum_ms / 1000);
+  out += line;
+  snprintf(line, sizeof(line), "%s_count%s%s%s %llu\n", name, open, labels, close, (unsigned long long)hist->count);
+  out += line;
+}
+
+double eval_stats_now() {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void eval_stats_reset(t_eval_stats *stats, bool enabled, bool histograms) {
+  memset(stats, 0, sizeof(t_eval_stats));
+  stats->enabled = enabled;
+  stats->histograms = histograms;
+}
+
+double eval_stats_start(const t_eval_stats *stats) {
+  return stats->enabled || stats->histograms? eval_stats_now() : 0;
+}
+
+void eval_stats_end(t_eval_stats *stats, t_eval_stage stage, double start) {
+  if (!stats->enabled && !stats->histograms) {
+    return;
+  }
+  double ms = eval_stats_now() - start;
+  if (stats->enabled) {
+    stats->stage_ms[stage] += ms;
+  }
+  if (stats->histograms) {
+    latency_hist_observe(&stats->stage_hist[stage], ms);
+  }
+}
+
+void eval_stats_end_machine(t_eval_stats *stats, double start) {
+  if (stats->histograms) {
+    latency_hist_observe(&stats->machine_hist, eval_stats_now() - start);
+  }
+}
+
+void merge_eval_stats(t_eval_stats *stats, const t_eval_stats *from) {
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    stats->stage_ms[i] += from->stage_ms[i];
+    latency_hist_merge(&stats->stage_hist[i], &from->stage_hist[i]);
+  }
+  latency_hist_merge(&stats->machine_hist, &from->machine_hist);
+  stats->search.ranges                 += from->search.ranges;
+  stats->search.modeline_creates       += from->search.modeline_creates;
+  stats->search.line_params_iterations += from->search.line_params_iterations;
+  stats->search.modeline_compares      += from->search.modeline_compares;
+}
+
+size_t peak_heap_bytes() {
+#ifdef __wasm__
+  return size_t(__builtin_wasm_memory_size(0)) * 65536;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) return 0;
+  return size_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+json serialize_eval_stats(const t_eval_stats *stats, const line_params_cache *line_cache) {
+  json stage_ms = json::object();
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    stage_ms[stage_names[i]] = stats->stage_ms[i];
+  }
+
+  return {
+    {"machines",             stats->machines                     },
+    {"stageMs",              stage_ms                            },
+    {"ranges",               stats->search.ranges                },
+    {"modelineCreates",      stats->search.modeline_creates      },
+    {"lineParamsIterations", stats->search.line_params_iterations},
+    {"modelineCompares",     stats->search.modeline_compares     },
+    {"lineParamsLookups",    line_cache->lookups                 },
+    {"lineParamsHits",       line_cache->hits                    },
+    {"peakHeapBytes",        peak_heap_bytes()                   }
+  };
+}
+
+std::string serialize_latency_metrics(const t_eval_stats *stats) {
+  std::string out;
+  out += "# HELP switchres_machine_seconds Time to evaluate a machine, every screen included.\n";
+  out += "# TYPE switchres_machine_seconds histogram\n";
+  latency_hist_serialize(out, "switchres_machine_seconds", "", &stats->machine_hist);
+
+  out += "# HELP switchres_stage_seconds Time per stage, per batch for parse and monitor and per screen otherwise.\n";
+  out += "# TYPE switchres_stage_seconds histogram\n";
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    std::string labels = std::string("stage=\"") + stage_names[i] + "\"";
+    latency_hist_serialize(out, "switchres_stage_seconds", labels.c_str(), &stats->stage_hist[i]);
+  }
+  return out;
+}
+
+void write_latency_metrics(const char *path, const t_eval_stats *stats) {
+  std::string metrics = serialize_latency_metrics(stats);
+  if (!strcmp(path, "-")) {
+    fputs(metrics.c_str(), stderr);
+    return;
+  }
+
+  std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(path, "w"), fclose);
+  if (!file || fputs(metrics.c_str(), file.get()) < 0) {
+    throw std::runtime_error(std::string("Unable to write the metrics file: ") + path);
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef __EVAL_STATS_H__
+#define __EVAL_STATS_H__
+
+#include "ext.h"
+#include "../lib/json.hpp"
+#include <string>
+
+using json = nlohmann::json;
+
+typedef enum {
+  STAGE_PARSE,      // input JSON
+  STAGE_MONITOR,    // monitor profile and default results
+  STAGE_GAME_INFO,  // machine instances (switchres_get_game_info)
+  STAGE_SEARCH,     // mode search or default result lookup
+  STAGE_SERIALIZE,  // results and output JSON
+  STAGE_COUNT
+} t_eval_stage;
+
+#define LATENCY_BUCKETS 22
+
+// latency counts per bucket, the bounds are latency_bucket_bounds (in
+// seconds) and the last bucket is +Inf. Buckets aren't cumulative.
+typedef struct t_latency_hist {
+  uint64_t buckets[LATENCY_BUCKETS + 1];
+  uint64_t count;
+  double   sum_ms;
+} t_latency_hist;
+
+extern const double latency_bucket_bounds[LATENCY_BUCKETS];
+
+// Where the time of a batch goes, collected when "stats" is requested.
+// When disabled the stage timers don't read the clock and the search
+// counters aren't hooked up (cs.search_stats stays NULL), so the only cost
+// is a branch per stage and per counter.
+//
+// With histograms the stage timers also record every stage's latency and
+// the callers every machine's. The stats are per worker so nothing is
+// shared, workers' stats are merged once the batch is done.
+typedef struct t_eval_stats {
+  bool           enabled;
+  bool           histograms;
+  double         stage_ms[STAGE_COUNT];
+  size_t         machines;
+  search_stats   search;
+  t_latency_hist stage_hist[STAGE_COUNT];
+  t_latency_hist machine_hist;
+} t_eval_stats;
+
+void eval_stats_reset(t_eval_stats *stats, bool enabled, bool histograms);
+
+// the start of a stage or machine, 0 when disabled
+double eval_stats_start(const t_eval_stats *stats);
+double eval_stats_now();
+void eval_stats_end(t_eval_stats *stats, t_eval_stage stage, double start);
+void eval_stats_end_machine(t_eval_stats *stats, double start);
+
+// adds the counters, stage times and histograms of from
+void merge_eval_stats(t_eval_stats *stats, const t_eval_stats *from);
+
+// the histograms in the Prometheus text exposition format
+std::string serialize_latency_metrics(const t_eval_stats *stats);
+
+// writes them to path, or stderr for "-" (stdout only carries the JSON
+// output)
+void write_latency_metrics(const char *path, const t_eval_stats *stats);
+
+// the process' peak memory: the wasm memory size (it only grows) or the
+// peak resident set natively
+size_t peak_heap_bytes();
+
+json serialize_eval_stats(const t_eval_stats *stats, const line_params_cache *line_cache);
+
+#endif // __EVAL_STATS_H__
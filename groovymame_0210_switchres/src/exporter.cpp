@@ -0,0 +1,335 @@
+#include "exporter.h"
+#include "default_results.h"
+#include "parallel.h"
+#include <cerrno>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <set>
+#include <sys/stat.h>
+
+static char *append_str(char *str, const char *value) {
+  while (*value) *str++ = *value++;
+  return str;
+}
+
+static char *append_int(char *str, int value) {
+  char digits[12];
+  int n = 0;
+  unsigned int u = value < 0? 0u - unsigned(value) : unsigned(value);
+  do {
+    digits[n++] = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  if (value < 0) *str++ = '-';
+  while (n) *str++ = digits[--n];
+  return str;
+}
+
+// Same as "%.6f". The fraction scaled by 10^6 is off by less than 1e-9
+// from the exact value, so the rounding is only left to sprintf when the
+// remainder is that close to a tie (and for values the integer part
+// doesn't fit).
+static char *append_fixed6(char *str, double value) {
+  double a = fabs(value);
+  if (!(a < 1e15)) {
+    return str + sprintf(str, "%.6f", value);
+  }
+
+  double int_part = floor(a);
+  double scaled = (a - int_part) * 1000000.0;
+  double frac_part = floor(scaled);
+  double rem = scaled - frac_part;
+  if (fabs(rem - 0.5) < 1e-9) {
+    return str + sprintf(str, "%.6f", value);
+  }
+
+  u64 i = u64(int_part);
+  u32 f = u32(frac_part) + (rem > 0.5? 1 : 0);
+  if (f == 1000000) {
+    f = 0;
+    ++i;
+  }
+
+  char digits[24];
+  int n = 0;
+  do {
+    digits[n++] = '0' + i % 10;
+    i /= 10;
+  } while (i);
+  if (std::signbit(value)) *str++ = '-';
+  while (n) *str++ = digits[--n];
+
+  *str++ = '.';
+  for (int d = 5; d >= 0; --d) {
+    str[d] = '0' + f % 10;
+    f /= 10;
+  }
+  return str + 6;
+}
+
+char *format_modeline(char *str, const modeline *mode, int flags) {
+  if (flags & MS_LABEL_SDL) {
+    str = append_str(str, "\"");
+    str = append_int(str, mode->hactive);
+    str = append_str(str, "x");
+    str = append_int(str, mode->vactive);
+    str = append_str(str, "_");
+    str = append_fixed6(str, mode->vfreq);
+    str = append_str(str, "\"");
+  }
+  else if (flags & MS_LABEL) {
+    str = append_str(str, "\"");
+    str = append_int(str, mode->hactive);
+    str = append_str(str, "x");
+    str = append_int(str, mode->vactive);
+    str = append_str(str, "_");
+    str = append_int(str, mode->refresh);
+    str = append_str(str, " ");
+    str = append_fixed6(str, mode->hfreq/1000);
+    str = append_str(str, "KHz ");
+    str = append_fixed6(str, mode->vfreq);
+    str = append_str(str, "Hz\"");
+  }
+
+  if (flags & MS_PARAMS) {
+    const int values[] = {mode->hactive, mode->hbegin, mode->hend, mode->htotal, mode->vactive, mode->vbegin, mode->vend, mode->vtotal};
+    str = append_str(str, " ");
+    str = append_fixed6(str, float(mode->pclock)/1000000.0);
+    for (int value : values) {
+      str = append_str(str, " ");
+      str = append_int(str, value);
+    }
+    str = append_str(str, mode->interlace?" interlace":" ");
+    str = append_str(str, mode->doublescan?" doublescan":" ");
+    str = append_str(str, mode->hsync?" +hsync":" -hsync");
+    str = append_str(str, mode->vsync?" +vsync":" -vsync");
+  }
+
+  *str = '\x00';
+  return str;
+}
+
+// a machine of the current chunk
+typedef struct t_export_machine {
+  char             name[256];
+  std::string      err;
+  std::vector<int> keys; // key index per display
+} t_export_machine;
+
+typedef struct t_export_writer {
+  const t_export_options *options;
+  FILE                   *file;  // the concatenated file
+  std::set<std::string>   modes; // labels already in the concatenated file
+  std::string             text;
+} t_export_writer;
+
+static const char *export_extension(t_export_format format) {
+  return format == EXPORT_INI? ".ini" : format == EXPORT_XRANDR? ".sh" : ".txt";
+}
+
+static FILE *open_export_file(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    throw std::invalid_argument("Unable to write export file: " + path);
+  }
+  return file;
+}
+
+static void write_export_file(FILE *file, const std::string &path, const std::string &text) {
+  if (fwrite(text.data(), 1, text.size(), file) != text.size()) {
+    throw std::invalid_argument("Unable to write export file: " + path);
+  }
+}
+
+// appends the machine's config to writer->text, nothing when the
+// concatenated file already has the mode
+static void format_export_config(t_export_writer *writer, const char *name, const modeline *mode) {
+  const t_export_options *options = writer->options;
+  char label[64], params[256];
+
+  if (options->format == EXPORT_INI) {
+    format_modeline(params, mode, MS_FULL);
+    writer->text.append("# ").append(name).append("\n");
+    writer->text.append("switchres                 1\n");
+    writer->text.append("modeline                  ").append(params).append("\n");
+    if (!options->split) writer->text.append("\n");
+    return;
+  }
+
+  if (options->format == EXPORT_XRANDR) {
+    format_modeline(label, mode, MS_LABEL_SDL);
+    if (!options->split && !writer->modes.insert(label).second) return;
+    format_modeline(params, mode, MS_PARAMS);
+    if (options->split) writer->text.append("#!/bin/sh\n");
+    writer->text.append("xrandr --newmode ").append(label).append(params).append("\n");
+    writer->text.append("xrandr --addmode ").append(options->xrandr_output).append(" ").append(label).append("\n");
+    return;
+  }
+
+  char *str = label;
+  str = append_int(str, mode->hactive);
+  str = append_str(str, "x");
+  str = append_int(str, mode->vactive);
+  str = append_str(str, mode->interlace? "i@" : "@");
+  str = append_fixed6(str, mode->vfreq);
+  *str = '\x00';
+  if (!options->split && !writer->modes.insert(label).second) return;
+  writer->text.append(label).append("\n");
+}
+
+static bool valid_file_name(const char *name) {
+  return *name && *name != '.' && !strchr(name, '/') && !strchr(name, '\\');
+}
+
+void export_machine_configs(const t_monitor_profile *profile, int default_results, std::vector<json> &machines, const t_export_options *options, t_export_stats *stats) {
+  stats->machines = machines.size();
+  stats->exported = stats->files = 0;
+  stats->out_of_range = json::array();
+  stats->machine_errs = json::object();
+
+  t_export_writer writer;
+  writer.options = options;
+  writer.file = NULL;
+
+  if (options->split) {
+    if (mkdir(options->path.c_str(), 0777) && errno != EEXIST) {
+      throw std::invalid_argument("Unable to create export directory: " + options->path);
+    }
+  }
+  else {
+    writer.file = open_export_file(options->path);
+    setvbuf(writer.file, NULL, _IOFBF, 1 << 20);
+    if (options->format == EXPORT_XRANDR) {
+      writer.text = "#!/bin/sh\n";
+    }
+  }
+
+  int workers = parallel_workers(options->workers);
+  std::vector<std::unique_ptr<t_eval_context>> contexts;
+  for (int i = 0; i < workers; ++i) {
+    contexts.push_back(std::unique_ptr<t_eval_context>(create_eval_context()));
+  }
+
+  // best mode per display key, shared by every chunk
+  std::map<t_display_key, int> key_indexes;
+  std::vector<modeline> key_modes;
+
+  try {
+    for (size_t first = 0; first < machines.size(); first += EXPORT_CHUNK) {
+      size_t count = std::min(machines.size() - first, size_t(EXPORT_CHUNK));
+      std::vector<t_export_machine> chunk(count);
+      std::vector<t_machine_display> new_displays;
+
+      for (size_t i = 0; i < count; ++i) {
+        t_export_machine *machine = &chunk[i];
+        machine->name[0] = '\x00';
+        try {
+          copy_json_str(machines[first + i]["name"].get<std::string>().c_str(), machine->name);
+          if (options->split && !valid_file_name(machine->name)) {
+            throw std::invalid_argument("Invalid machine name for a file name.");
+          }
+
+          std::vector<json> machine_displays = get_machine_displays_json(machines[first + i]);
+          if (machine_displays.empty()) {
+            throw std::invalid_argument("Machine has no display.");
+          }
+          for (json &machine_display : machine_displays) {
+            t_machine_display display;
+            parse_machine_display(machine_display, &display);
+
+            machine_instance instance(profile, machine->name, &display);
+            std::pair<std::map<t_display_key, int>::iterator, bool> inserted = key_indexes.insert(std::make_pair(instance.key(), int(key_modes.size() + new_displays.size())));
+            if (inserted.second) {
+              new_displays.push_back(display);
+            }
+            machine->keys.push_back(inserted.first->second);
+          }
+        } catch(const std::exception& err) {
+          machine->err = err.what();
+        }
+      }
+
+      size_t key_offset = key_modes.size();
+      key_modes.resize(key_offset + new_displays.size());
+      parallel_for(new_displays.size(), workers, [&](size_t i, int worker) {
+        machine_instance instance(profile, "", &new_displays[i]);
+        t_display_key key = instance.key();
+        const modeline *default_mode = default_results >= 0? lookup_default_result(default_results, &key) : NULL;
+        if (default_mode) {
+          key_modes[key_offset + i] = *default_mode;
+          return;
+        }
+
+        instance.search(contexts[worker].get());
+        t_machine_result result;
+        instance.get_result(&result);
+        key_modes[key_offset + i] = result.best_mode;
+      });
+
+      for (t_export_machine &machine : chunk) {
+        if (!machine.err.empty()) {
+          fprintf(stderr, "err: %s\n", machine.err.c_str());
+          stats->machine_errs[machine.name] = machine.err;
+          continue;
+        }
+
+        // like calc_modeline, the worst screen's mode
+        const modeline *mode = NULL;
+        int worst_flags = -1;
+        for (int key : machine.keys) {
+          int flags = key_modes[key].result.weight & (R_OUT_OF_RANGE | R_RES_STRETCH | R_V_FREQ_OFF);
+          if (flags > worst_flags) {
+            mode = &key_modes[key];
+            worst_flags = flags;
+          }
+        }
+        if (worst_flags & R_OUT_OF_RANGE) {
+          stats->out_of_range.push_back(machine.name);
+          continue;
+        }
+
+        if (options->split) {
+          writer.text.clear();
+          format_export_config(&writer, machine.name, mode);
+          std::string path = options->path + "/" + machine.name + export_extension(options->format);
+          FILE *file = open_export_file(path);
+          try {
+            write_export_file(file, path, writer.text);
+          } catch(...) {
+            fclose(file);
+            throw;
+          }
+          if (fclose(file)) {
+            throw std::invalid_argument("Unable to write export file: " + path);
+          }
+          ++stats->files;
+        }
+        else {
+          format_export_config(&writer, machine.name, mode);
+        }
+        ++stats->exported;
+      }
+
+      if (writer.file) {
+        write_export_file(writer.file, options->path, writer.text);
+        writer.text.clear();
+      }
+    }
+  } catch(...) {
+    if (writer.file) fclose(writer.file);
+    throw;
+  }
+
+  for (std::unique_ptr<t_eval_context> &context : contexts) {
+    show_eval_context(context.get());
+  }
+
+  if (writer.file) {
+    if (fclose(writer.file)) {
+      throw std::invalid_argument("Unable to write export file: " + options->path);
+    }
+    ++stats->files;
+  }
+}
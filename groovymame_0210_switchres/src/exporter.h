@@ -0,0 +1,45 @@
+#ifndef __EXPORTER_H__
+#define __EXPORTER_H__
+
+#include "engine.h"
+#include <string>
+#include <vector>
+
+// machines evaluated (in parallel) before their configs are written out
+#define EXPORT_CHUNK 4096
+
+typedef enum {
+  EXPORT_INI,     // MAME ini switchres/modeline lines
+  EXPORT_XRANDR,  // xrandr --newmode/--addmode commands
+  EXPORT_MODELIST // <width>x<height>[i]@<vfreq> lines, as read by parse_video_modes
+} t_export_format;
+
+typedef struct t_export_options {
+  t_export_format format;
+  std::string     path;          // the file, or the directory when split
+  bool            split;         // a file per machine (<path>/<name>.<ext>)
+  std::string     xrandr_output; // the output xrandr adds the modes to
+  int             workers;
+} t_export_options;
+
+typedef struct t_export_stats {
+  size_t machines;
+  size_t exported;
+  size_t files;
+  json   out_of_range;  // machine names
+  json   machine_errs;  // machine name -> err
+} t_export_stats;
+
+// Writes the config of each machine's best mode as the results are
+// computed, without building the results JSON. Machines with the same
+// display key share the evaluation, and machines that are out of range
+// don't get a config. The concatenated xrandr and mode list files only
+// have each mode once (by label) since they set up a whole library at
+// once.
+void export_machine_configs(const t_monitor_profile *profile, int default_results, std::vector<json> &machines, const t_export_options *options, t_export_stats *stats);
+
+// Same output as modeline_print without sprintf, returns the end of the
+// string.
+char *format_modeline(char *str, const modeline *mode, int flags);
+
+#endif // __EXPORTER_H__
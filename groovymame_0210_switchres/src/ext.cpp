@@ -2,18 +2,39 @@
 #include <cstdarg>
 #include "ext.h"
 
+static thread_local osd_printf_sink printf_sink = NULL;
+static thread_local void *printf_sink_param = NULL;
+
+void osd_set_printf_sink(osd_printf_sink sink, void *param)
+{
+  printf_sink = sink;
+  printf_sink_param = param;
+}
+
+static void osd_vprintf(const char *format, va_list argptr)
+{
+  if (printf_sink)
+  {
+    char text[1024];
+    vsnprintf(text, sizeof(text), format, argptr);
+    printf_sink(text, printf_sink_param);
+  }
+  else
+    vfprintf(stderr, format, argptr);
+}
+
 void osd_printf_error(const char *format, ...)
 {
   va_list argptr;
   va_start(argptr, format);
-  vfprintf(stderr, format, argptr);
+  osd_vprintf(format, argptr);
   va_end(argptr);
 }
 void osd_printf_warning(const char *format, ...)
 {
   va_list argptr;
   va_start(argptr, format);
-  vfprintf(stderr, format, argptr);
+  osd_vprintf(format, argptr);
   va_end(argptr);
 }
 void osd_printf_info(const char *format, ...)
@@ -15,6 +15,11 @@ void osd_printf_verbose(const char *format, ...);
 void osd_printf_debug(const char *format, ...);
 void osd_printf_log(const char *format, ...);
 
+// Errors and warnings go to stderr, unless the calling thread set a sink
+// (NULL to restore stderr). libswitchres collects them this way.
+typedef void (*osd_printf_sink)(const char *text, void *param);
+void osd_set_printf_sink(osd_printf_sink sink, void *param);
+
 
 using s8 = int8_t;
 using u8 = uint8_t;
@@ -217,6 +222,11 @@ class emu_options {
     char m_ranges[MAX_RANGES][MAX_RANGE_LEN];
     bool m_allow_interlaced;
     bool m_allow_doublescan;
+    int  m_super_width;
+    char m_dotclock_min[32] = {'\x00'};
+    char m_sync_refresh_tolerance[32] = {'\x00'};
+    bool m_lock_system_modes;
+    char m_modeline[256] = {'\x00'};
     
     emu_options(game_driver *system)
     : m_system(system)
@@ -224,6 +234,11 @@ class emu_options {
       memset(m_ranges, 0, sizeof(char) * MAX_RANGES * MAX_RANGE_LEN);
       m_allow_interlaced = true;
       m_allow_doublescan = true;
+      m_super_width = 2560;
+      strcpy(m_dotclock_min, "0");
+      strcpy(m_sync_refresh_tolerance, "2.0");
+      m_lock_system_modes = true;
+      strcpy(m_modeline, "auto");
     }
     const char* system_name() const
     {
@@ -259,10 +274,10 @@ class emu_options {
     bool doublescan() const { return m_allow_doublescan; }
     
     // { OPTION_SUPER_WIDTH ";cs",                          "2560",      OPTION_INTEGER,    "Automatically apply -unevenstretchx if resolution width is equal or greater than this value" },
-    int super_width() const { return 2560; }
+    int super_width() const { return m_super_width; }
     
     // { OPTION_LOCK_SYSTEM_MODES ";lsm",                   "1",         OPTION_BOOLEAN,    "Lock system (non-custom) video modes, only use modes created by us" },
-    bool lock_system_modes() const { return true; }
+    bool lock_system_modes() const { return m_lock_system_modes; }
     
     // { OPTION_LOCK_UNSUPPORTED_MODES ";lum",              "1",         OPTION_BOOLEAN,    "Lock video modes reported as unsupported by your monitor's EDID" },
     bool lock_unsupported_modes() const { return true; }
@@ -271,13 +286,13 @@ class emu_options {
     bool refresh_dont_care() const { return false; }
     
     // { OPTION_DOTCLOCK_MIN ";dcm",                        "0",         OPTION_STRING,     "Lowest pixel clock supported by video card, in MHz, default is 0" },
-    const char *dotclock_min() const { return "0"; }
+    const char *dotclock_min() const { return m_dotclock_min; }
     
     // { OPTION_SYNC_REFRESH_TOLERANCE ";srt",              "2.0",       OPTION_STRING,     "Maximum refresh difference, in Hz, allowed in order to synchronize" },
-    const char *sync_refresh_tolerance() const { return "2.0"; }
+    const char *sync_refresh_tolerance() const { return m_sync_refresh_tolerance; }
     
     // { OPTION_MODELINE ";mode",                           "auto",      OPTION_STRING,     "Use custom defined modeline" },
-    const char *modeline() const { return "auto"; }
+    const char *modeline() const { return m_modeline; }
     
     // { OPTION_LCD_RANGE ";lcd",                           "auto",      OPTION_STRING,     "Add custom LCD range, VfreqMin-VfreqMax, in Hz, e.g.: 55.50-61.00" },
     const char *lcd_range() const { return "auto"; }
@@ -0,0 +1,168 @@
+#include "libswitchres.h"
+#include "engine.h"
+#include "default_results.h"
+#include "parallel.h"
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <string>
+
+struct t_switchres_monitor {
+  t_monitor_profile profile;
+  int               default_results;
+};
+
+static void copy_text(char *dest, size_t size, const char *text) {
+  if (dest && size) snprintf(dest, size, "%s", text);
+}
+
+// collects the engine's errors and warnings of the calling thread instead
+// of writing them to stderr, they are dropped without `messages`
+struct t_printf_capture {
+  t_printf_capture(std::string *messages) {
+    osd_set_printf_sink(append, messages);
+  }
+  ~t_printf_capture() {
+    osd_set_printf_sink(NULL, NULL);
+  }
+  static void append(const char *text, void *param) {
+    if (param) static_cast<std::string*>(param)->append(text);
+  }
+};
+
+// same as eval_machine_instance for a single screen machine
+static void eval_display(const t_switchres_monitor *monitor, const t_switchres_display *display, t_switchres_result *result, t_eval_context *context) {
+  memset(result, 0, sizeof(t_switchres_result));
+  // an out of range result is flagged, the message adds nothing
+  t_printf_capture capture(NULL);
+
+  if (display->type < SWITCHRES_SCREEN_RASTER || display->type > SWITCHRES_SCREEN_SVG) {
+    result->status = SWITCHRES_ERR_DISPLAY;
+    copy_text(result->text, sizeof(result->text), "Invalid display type.");
+    return;
+  }
+
+  try {
+    t_machine_display machine_display;
+    machine_display.type    = screen_type_enum(display->type);
+    machine_display.refresh = display->refresh;
+    machine_display.width   = display->type == SWITCHRES_SCREEN_VECTOR? 0 : display->width;
+    machine_display.height  = display->type == SWITCHRES_SCREEN_VECTOR? 0 : display->height;
+    machine_display.rotate  = display->rotate;
+    machine_display.flipx   = display->flipx != 0;
+
+    machine_instance instance(&monitor->profile, "", &machine_display);
+    instance.machine.switchres.game.screens = 1;
+
+    t_display_key key = instance.key();
+    const modeline *default_mode = monitor->default_results >= 0? lookup_default_result(monitor->default_results, &key) : NULL;
+    if (!default_mode) {
+      instance.search(context);
+    }
+
+    t_machine_result machine_result;
+    instance.get_result(&machine_result);
+    modeline *best_mode = &machine_result.best_mode;
+    if (default_mode) {
+      *best_mode = *default_mode;
+    }
+
+    result->status = SWITCHRES_OK;
+    result->flags = best_mode->result.weight & (R_OUT_OF_RANGE | R_RES_STRETCH | R_V_FREQ_OFF);
+    if (result->flags & R_OUT_OF_RANGE) {
+      return;
+    }
+
+    t_switchres_modeline *mode = &result->mode;
+    mode->pclock     = best_mode->pclock;
+    mode->hactive    = best_mode->hactive;
+    mode->hbegin     = best_mode->hbegin;
+    mode->hend       = best_mode->hend;
+    mode->htotal     = best_mode->htotal;
+    mode->vactive    = best_mode->vactive;
+    mode->vbegin     = best_mode->vbegin;
+    mode->vend       = best_mode->vend;
+    mode->vtotal     = best_mode->vtotal;
+    mode->interlace  = best_mode->interlace;
+    mode->doublescan = best_mode->doublescan;
+    mode->hsync      = best_mode->hsync;
+    mode->vsync      = best_mode->vsync;
+    mode->hfreq      = best_mode->hfreq;
+    mode->vfreq      = best_mode->vfreq;
+
+    char modeline_str[512] = {'\x00'};
+    modeline_print(best_mode, modeline_str, MS_LABEL | MS_PARAMS);
+    copy_text(result->text, sizeof(result->text), modeline_str);
+  }
+  catch(const std::exception& err) {
+    memset(result, 0, sizeof(t_switchres_result));
+    result->status = SWITCHRES_ERR_DISPLAY;
+    copy_text(result->text, sizeof(result->text), err.what());
+  }
+}
+
+extern "C" {
+
+int switchres_abi_version(void) {
+  return SWITCHRES_ABI_VERSION;
+}
+
+int switchres_monitor_create(const char *config_json, t_switchres_monitor **monitor, char *err, size_t err_size) {
+  copy_text(err, err_size, "");
+  if (!config_json || !monitor) {
+    copy_text(err, err_size, "Missing argument.");
+    return SWITCHRES_ERR_ARGUMENT;
+  }
+  *monitor = NULL;
+
+  std::string messages;
+  t_printf_capture capture(&messages);
+
+  try {
+    json config = json::parse(config_json);
+    std::unique_ptr<t_switchres_monitor> new_monitor(new t_switchres_monitor);
+    build_monitor_profile(config, &new_monitor->profile);
+    new_monitor->default_results = find_default_results(&new_monitor->profile);
+    *monitor = new_monitor.release();
+    copy_text(err, err_size, messages.c_str());
+    return SWITCHRES_OK;
+  }
+  catch(const std::bad_alloc& e) {
+    copy_text(err, err_size, e.what());
+    return SWITCHRES_ERR_INTERNAL;
+  }
+  catch(const std::exception& e) {
+    copy_text(err, err_size, (std::string(e.what()) + (messages.empty()? "" : "\n") + messages).c_str());
+    return SWITCHRES_ERR_CONFIG;
+  }
+}
+
+void switchres_monitor_destroy(t_switchres_monitor *monitor) {
+  delete monitor;
+}
+
+int switchres_eval_batch(const t_switchres_monitor *monitor, const t_switchres_display *displays, size_t count, t_switchres_result *results, int threads) {
+  if (!monitor || (count && (!displays || !results)) || threads < 0) {
+    return SWITCHRES_ERR_ARGUMENT;
+  }
+
+  try {
+    // the line params cache of a context is only valid for one monitor, so
+    // contexts live for the call
+    int workers = int(std::min(size_t(parallel_workers(threads)), std::max(count, size_t(1))));
+    std::vector<std::unique_ptr<t_eval_context>> contexts;
+    for (int i = 0; i < workers; ++i) {
+      contexts.push_back(std::unique_ptr<t_eval_context>(create_eval_context()));
+    }
+
+    parallel_for(count, workers, [&](size_t i, int worker) {
+      eval_display(monitor, &displays[i], &results[i], contexts[worker].get());
+    });
+    return SWITCHRES_OK;
+  }
+  catch(...) {
+    return SWITCHRES_ERR_INTERNAL;
+  }
+}
+
+}
@@ -0,0 +1,116 @@
+#ifndef __LIBSWITCHRES_H__
+#define __LIBSWITCHRES_H__
+
+// C interface of libswitchres.so (make lib). A service loads the library
+// once and evaluates batches of machine displays against a monitor without
+// starting a process per query.
+//
+// The library has no global mutable state: a monitor is immutable once
+// created, so any number of threads can evaluate against the same monitor
+// (or different ones) at the same time. Every output goes to buffers the
+// caller owns, nothing returned has to be freed besides the monitor. The
+// library never writes to stdout or stderr, the engine's messages go to
+// the err buffer of switchres_monitor_create.
+//
+// The structs and values below are frozen for a given
+// SWITCHRES_ABI_VERSION, which is also the library's soname version
+// (libswitchres.so.<version>). A change to them bumps it.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SWITCHRES_ABI_VERSION 1
+
+#if defined(__GNUC__)
+#define SWITCHRES_API __attribute__((visibility("default")))
+#else
+#define SWITCHRES_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// status codes
+#define SWITCHRES_OK           0
+#define SWITCHRES_ERR_ARGUMENT -1 // NULL or invalid argument
+#define SWITCHRES_ERR_CONFIG   -2 // invalid monitor config
+#define SWITCHRES_ERR_DISPLAY  -3 // invalid display (per result)
+#define SWITCHRES_ERR_INTERNAL -4 // the engine failed (out of memory...)
+
+// display types, same as the "type" values of the JSON input
+#define SWITCHRES_SCREEN_RASTER 1
+#define SWITCHRES_SCREEN_VECTOR 2
+#define SWITCHRES_SCREEN_LCD    3
+#define SWITCHRES_SCREEN_SVG    4
+
+// result flags, as the weight flags of the JSON output. A machine with
+// several screens is as bad as its screen with the highest flags.
+#define SWITCHRES_V_FREQ_OFF    1
+#define SWITCHRES_RES_STRETCH   2
+#define SWITCHRES_OUT_OF_RANGE  4
+
+// a monitor config set up for evaluation, see switchres_monitor_create
+typedef struct t_switchres_monitor t_switchres_monitor;
+
+// a machine display, as the "display" object of the JSON input (width and
+// height are ignored for vectors)
+typedef struct t_switchres_display {
+  int    type;    // SWITCHRES_SCREEN_*
+  int    rotate;  // 0, 90, 180 or 270
+  int    flipx;
+  int    width;
+  int    height;
+  double refresh;
+} t_switchres_display;
+
+typedef struct t_switchres_modeline {
+  int64_t pclock; // Hz
+  int     hactive;
+  int     hbegin;
+  int     hend;
+  int     htotal;
+  int     vactive;
+  int     vbegin;
+  int     vend;
+  int     vtotal;
+  int     interlace;
+  int     doublescan;
+  int     hsync;  // 1 for +hsync
+  int     vsync;  // 1 for +vsync
+  double  hfreq;
+  double  vfreq;
+} t_switchres_modeline;
+
+typedef struct t_switchres_result {
+  int                  status; // SWITCHRES_OK or SWITCHRES_ERR_DISPLAY
+  int                  flags;  // SWITCHRES_* result flags
+  t_switchres_modeline mode;   // zeroed when out of range
+  // the modeline as "modelineStr" of the JSON output ("" when out of
+  // range), or the error message
+  char                 text[256];
+} t_switchres_result;
+
+// The SWITCHRES_ABI_VERSION the library was built with. Callers should
+// check it against the header they were compiled with.
+SWITCHRES_API int switchres_abi_version(void);
+
+// Sets up a monitor from the JSON "config" object of the calc_modelines
+// input (preset, orientation, ranges, allowInterlaced...). On failure the
+// message is written to err (up to err_size bytes, may be NULL), on
+// success the engine's warnings about the config (e.g. an ignored range),
+// "" without any.
+SWITCHRES_API int switchres_monitor_create(const char *config_json, t_switchres_monitor **monitor, char *err, size_t err_size);
+SWITCHRES_API void switchres_monitor_destroy(t_switchres_monitor *monitor);
+
+// Evaluates count displays into results[0..count). The batch is split
+// across up to `threads` threads (0 for one per hardware thread, 1 to stay
+// on the calling thread). A display that fails only fails its result; the
+// return value is SWITCHRES_OK unless the whole call failed.
+SWITCHRES_API int switchres_eval_batch(const t_switchres_monitor *monitor, const t_switchres_display *displays, size_t count, t_switchres_result *results, int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __LIBSWITCHRES_H__
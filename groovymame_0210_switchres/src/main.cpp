@@ -1,8 +1,22 @@
 #include "ext.h"
 #include "switchres.h"
 #include "switchres_proto.h"
+#include "engine.h"
+#include "compat_grid.h"
+#include "compat_matrix.h"
+#include "default_results.h"
+#include "exporter.h"
+#include "parallel.h"
+#include "probes.h"
+#include "range_optimizer.h"
+#include "sensitivity.h"
+#include "video_modes.h"
 #include "../lib/json.hpp"
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
 
 using json = nlohmann::json;
 
@@ -11,6 +25,21 @@ typedef struct t_machine_output {
   json output;
 } t_machine_output;
 
+// a monitor config with some of its options changed
+typedef struct t_option_variant {
+  json config;
+  std::string err;
+  std::unique_ptr<t_monitor_profile> profile;
+  int default_results;
+  int same_as; // index of an earlier identical variant, or -1
+  std::map<t_display_key, modeline> modes;
+} t_option_variant;
+
+// the only config keys a variant can change
+const char *const variant_options[] = {
+  "allowInterlaced", "allowDoublescan", "superWidth", "dotclockMin", "syncRefreshTolerance", "lockSystemModes", "modeline"
+};
+
 template <typename T>
 T get_json_or_0(json *j) {
   if (j->is_null()) {
@@ -19,23 +48,48 @@ T get_json_or_0(json *j) {
   return j->get<T>();
 }
 
-void copy_json_str(std::string str, char* dest) {
-  // not sure why this is necessary
-  strcpy(dest, str.c_str());
+// searches the best mode for the instance, or takes the compiled in result
+// when there is one (unless the machine is traced or they are disabled)
+json eval_machine_instance(machine_instance *instance, int default_results, t_eval_context *context, int *flags = NULL) {
+  double start = eval_stats_start(&context->stats);
+  t_display_key key = instance->key();
+  bool use_default = default_results >= 0 && !context->trace && !(context->disabled & EVAL_NO_DEFAULT_RESULTS);
+  const modeline *default_mode = use_default? lookup_default_result(default_results, &key) : NULL;
+  SWITCHRES_PROBE2(default__result, (const char *)instance->machine.switchres.game.name, default_mode? 1 : 0);
+  if (!default_mode) {
+    instance->search(context);
+  }
+  
+  t_machine_result result;
+  instance->get_result(&result);
+  if (default_mode) {
+    result.best_mode = *default_mode;
+  }
+  if (flags) {
+    *flags = result.best_mode.result.weight & (R_OUT_OF_RANGE | R_RES_STRETCH | R_V_FREQ_OFF);
+  }
+  eval_stats_end(&context->stats, STAGE_SEARCH, start);
+  
+  start = eval_stats_start(&context->stats);
+  json result_json = serialize_machine_result(&result);
+  eval_stats_end(&context->stats, STAGE_SERIALIZE, start);
+  return result_json;
 }
 
-t_machine_output calc_modeline(json config, json machine) {
+// Every display of a multi-screen machine is evaluated. The machine's
+// result is then the one of its worst screen (out of range, then
+// stretched, then off refresh) with every screen's result in "screens".
+t_machine_output calc_modeline(t_monitor_profile *profile, int default_results, json machine, t_eval_context *context) {
   t_machine_output machine_output;
   char machine_name[256] = {'\x00'};
-  json machine_display;
+  std::vector<json> machine_displays;
   
   try {
     copy_json_str(machine["name"].get<std::string>().c_str(), machine_name);
     
-    machine_display = machine["display"];
-    
-    if (machine_display.is_null()) {
-      machine_display = machine["displays"].get<std::vector<json>>().front();
+    machine_displays = get_machine_displays_json(machine);
+    if (machine_displays.empty()) {
+      throw std::invalid_argument("Machine has no display.");
     }
   } catch(const std::exception& err) {
     fprintf(stderr, "err: %s\n", err.what());
@@ -47,201 +101,253 @@ t_machine_output calc_modeline(json config, json machine) {
     return machine_output;
   }
   
+  SWITCHRES_PROBE1(machine__start, (const char *)machine_name);
+  
   try {
-    screen_device screen = screen_device();
+    context->trace = context->tracer? trace_machine(context->tracer, machine_name) : NULL;
+    std::vector<t_machine_display> displays(machine_displays.size());
+    std::vector<json> results;
+    std::vector<int> flags;
+    int worst = 0;
     
-    char screen_type_str[256] = {'\x00'};
-    copy_json_str(machine_display["type"].get<std::string>(), screen_type_str);
-    
-    screen_type_enum screen_type;
-    if (!strcmp(screen_type_str, "raster")) {
-      screen_type = SCREEN_TYPE_RASTER;
-    }
-    else if (!strcmp(screen_type_str, "vector")) {
-      screen_type = SCREEN_TYPE_VECTOR;
-    }
-    else if (!strcmp(screen_type_str, "lcd")) {
-      screen_type = SCREEN_TYPE_LCD;
-    }
-    else if (!strcmp(screen_type_str, "svg")) {
-      screen_type = SCREEN_TYPE_SVG;
-    }
-    else {
-      screen_type = SCREEN_TYPE_INVALID;
+    for (size_t i = 0; i < machine_displays.size(); ++i) {
+      parse_machine_display(machine_displays[i], &displays[i]);
+      
+      // screens with the same display have the same result
+      size_t same = std::find(displays.begin(), displays.begin() + i, displays[i]) - displays.begin();
+      if (same < i) {
+        results.push_back(results[same]);
+        flags.push_back(flags[same]);
+        continue;
+      }
+      
+      double start = eval_stats_start(&context->stats);
+      machine_instance instance(profile, machine_name, &displays[i]);
+      instance.machine.switchres.game.screens = machine_displays.size();
+      eval_stats_end(&context->stats, STAGE_GAME_INFO, start);
+      
+      int screen_flags;
+      results.push_back(eval_machine_instance(&instance, default_results, context, &screen_flags));
+      flags.push_back(screen_flags);
+      
+      if (flags[i] > flags[worst]) {
+        worst = i;
+      }
     }
+    context->trace = NULL;
+    SWITCHRES_PROBE2(machine__end, (const char *)machine_name, flags[worst]);
     
-    screen.set_type(screen_type);
-    screen.set_refresh_hz(machine_display["refresh"].get<double>());
-    
-    if (screen.screen_type() != SCREEN_TYPE_VECTOR) {
-      screen.set_visarea(
-        0,
-        machine_display["width"].get<s32>()-1,
-        0,
-        machine_display["height"].get<s32>()-1
-      );
+    strcpy(machine_output.machine_name, machine_name);
+    machine_output.output = results[worst];
+    if (results.size() > 1) {
+      machine_output.output["screens"] = results;
+      machine_output.output["worstScreen"] = worst;
     }
+    return machine_output;
+  }
+  catch(const std::exception& err) {
+    context->trace = NULL;
+    SWITCHRES_PROBE2(machine__end, (const char *)machine_name, -1);
+    fprintf(stderr, "err: %s\n", err.what());
+    json err_json = {
+      {"err", err.what()}
+    };
+    strcpy(machine_output.machine_name, machine_name);
+    machine_output.output = err_json;
+    return machine_output;
+  }
+}
+
+// Evaluates the machine once per monitor orientation option. The display is
+// only decoded once, and options that give the same effective orientation
+// (and so the same display key) share the result.
+t_machine_output calc_modeline_orientations(std::vector<t_monitor_profile> &profiles, std::vector<int> &default_results, json machine, t_eval_context *context, int *evaluations) {
+  t_machine_output machine_output;
+  char machine_name[256] = {'\x00'};
+  t_machine_display display;
+  
+  try {
+    copy_json_str(machine["name"].get<std::string>().c_str(), machine_name);
     
-    /*
-    screen.set_raw(
-      machine_display["pixclock"].get<u32>(),
-      machine_display["htotal"  ].get<u16>(),
-      machine_display["hbend"   ].get<u16>(),
-      machine_display["hbstart" ].get<u16>(),
-      machine_display["vtotal"  ].get<u16>(),
-      machine_display["vbend"   ].get<u16>(),
-      machine_display["vbstart" ].get<u16>()
-    );
-    */
-    
-    int machine_display_rotate = machine_display["rotate"].get<int>();
-    bool machine_display_flipx  = machine_display["flipx"].get<bool>();
-    
-    game_driver system = game_driver(
-      machine_name,
-      (
-        machine_flags::TYPE_ARCADE | (
-          (
-            machine_display_rotate ==  90? machine_flags::ROT90  :
-            machine_display_rotate == 180? machine_flags::ROT180 :
-            machine_display_rotate == 270? machine_flags::ROT180 :
-            0
-          )
-          ^ (machine_display_flipx? machine_flags::FLIP_X : 0)
-        )
-      ),
-      &screen
-    );
-    
-    emu_options options = emu_options(&system);
-    
-    json monitor_orientation_json = config["orientation"];
-    if (!monitor_orientation_json.is_null()) {
-      copy_json_str(monitor_orientation_json.get<std::string>(), options.m_orientation);
-    }
-    
-    json monitor_preset_json = config["preset"];
-    if (!monitor_preset_json.is_null()) {
-      copy_json_str(monitor_preset_json.get<std::string>(), options.m_monitor);
-    }
-    json monitor_ranges_json = config["ranges"];
-    if (!monitor_ranges_json.is_null()) {
-      std::vector<std::string> monitor_ranges_str = monitor_ranges_json.get<std::vector<std::string>>();
+    json machine_display = get_machine_display_json(machine);
+    parse_machine_display(machine_display, &display);
+  } catch(const std::exception& err) {
+    fprintf(stderr, "err: %s\n", err.what());
+    json err_json = {
+      {"err", err.what()}
+    };
+    strcpy(machine_output.machine_name, machine_name);
+    machine_output.output = err_json;
+    return machine_output;
+  }
+  
+  std::vector<t_display_key> keys;
+  std::vector<json> results;
+  
+  strcpy(machine_output.machine_name, machine_name);
+  machine_output.output = json::object();
+  for (size_t i = 0; i < profiles.size(); ++i) {
+    const char *orientation = profiles[i].config.orientation;
+    
+    try {
+      machine_instance instance(&profiles[i], machine_name, &display);
+      t_display_key key = instance.key();
       
-      int i;
-      std::vector<std::string>::iterator it;
-      for (
-        i = 0,    it = monitor_ranges_str.begin();
-        i < 10 && it != monitor_ranges_str.end();
-        ++i,      ++it
-      ) {
-        it->resize(MAX_RANGE_LEN-1);
-        strcpy(options.m_ranges[i], it->c_str());
+      std::vector<t_display_key>::iterator it = std::find(keys.begin(), keys.end(), key);
+      if (it != keys.end()) {
+        machine_output.output[orientation] = results[it - keys.begin()];
+        continue;
       }
+      
+      json result = eval_machine_instance(&instance, default_results[i], context);
+      ++*evaluations;
+      
+      keys.push_back(key);
+      results.push_back(result);
+      machine_output.output[orientation] = result;
     }
-    
-    json allow_interlaced_json = config["allowInterlaced"];
-    if (!allow_interlaced_json.is_null()) {
-      options.m_allow_interlaced = allow_interlaced_json.get<bool>();
-    }
-    
-    json allow_doublescan_json = config["allowDoublescan"];
-    if (!allow_doublescan_json.is_null()) {
-      options.m_allow_doublescan = allow_doublescan_json.get<bool>();
+    catch(const std::exception& err) {
+      fprintf(stderr, "err: %s\n", err.what());
+      machine_output.output[orientation] = {
+        {"err", err.what()}
+      };
     }
+  }
+  return machine_output;
+}
+
+// Evaluates the machine for each option variant. The machine is only set up
+// once as the options don't change the game info or the display key, and
+// each variant keeps the best mode of every key it has searched so later
+// machines with the same key don't search again.
+t_machine_output calc_modeline_variants(t_monitor_profile *profile, std::vector<t_option_variant> &variants, json machine, t_eval_context *context) {
+  t_machine_output machine_output;
+  char machine_name[256] = {'\x00'};
+  
+  try {
+    copy_json_str(machine["name"].get<std::string>().c_str(), machine_name);
+    strcpy(machine_output.machine_name, machine_name);
     
+    json machine_display = get_machine_display_json(machine);
+    t_machine_display display;
+    parse_machine_display(machine_display, &display);
     
-    render_manager render = render_manager(); 
-    
-    running_machine machine = running_machine(&system, &options, &render);
-    machine.switchres.cs.monitor_aspect = STANDARD_CRT_ASPECT;
-    
-    switchres_get_game_info(machine);
-    switchres_init(machine);
+    machine_instance instance(profile, machine_name, &display);
+    t_display_key key = instance.key();
     
-    modeline *mode = &machine.switchres.user_mode;
-    mode->width = mode->height = 1;
-    mode->refresh = 60;
-    mode->vfreq = mode->refresh;
-    mode->hactive = mode->vactive = 1;
-    mode->type = XYV_EDITABLE | XRANDR_TIMING | (machine.switchres.cs.desktop_rotated? MODE_ROTATED : MODE_OK);
+    machine_output.output = json::array();
+    for (size_t i = 0; i < variants.size(); ++i) {
+      t_option_variant *variant = &variants[i];
+      if (!variant->err.empty()) {
+        machine_output.output.push_back({
+          {"err", variant->err}
+        });
+        continue;
+      }
+      if (variant->same_as >= 0) {
+        machine_output.output.push_back(machine_output.output[variant->same_as]);
+        continue;
+      }
+      
+      t_machine_result result;
+      instance.get_result(&result);
+      
+      std::map<t_display_key, modeline>::iterator it = variant->modes.find(key);
+      if (it == variant->modes.end()) {
+        const modeline *default_mode = variant->default_results >= 0? lookup_default_result(variant->default_results, &key) : NULL;
+        if (!default_mode) {
+          instance.set_profile(variant->profile.get());
+          instance.search(context);
+        }
+        it = variant->modes.insert(std::make_pair(key, default_mode? *default_mode : instance.machine.switchres.best_mode)).first;
+      }
+      
+      result.best_mode = it->second;
+      machine_output.output.push_back(serialize_machine_result(&result));
+    }
+    return machine_output;
+  }
+  catch(const std::exception& err) {
+    fprintf(stderr, "err: %s\n", err.what());
+    json err_json = {
+      {"err", err.what()}
+    };
+    strcpy(machine_output.machine_name, machine_name);
+    machine_output.output = err_json;
+    return machine_output;
+  }
+}
+
+// Runs the machine through its "states" (each with optional "width",
+// "height" and "refresh" replacing the display's) and returns the mode for
+// each state and whether getting there needs a mode switch. A state that
+// SwitchRes doesn't see as a resolution change, or that maps to the same
+// display key, keeps the current mode without a search. Best modes are
+// shared through `modes` by every machine of the batch.
+t_machine_output calc_modeline_timeline(t_monitor_profile *profile, int default_results, json machine, t_eval_context *context, std::map<t_display_key, modeline> &modes) {
+  t_machine_output machine_output;
+  char machine_name[256] = {'\x00'};
+  
+  try {
+    copy_json_str(machine["name"].get<std::string>().c_str(), machine_name);
+    strcpy(machine_output.machine_name, machine_name);
     
-    char modeline_txt[256]={'\x00'};
-    osd_printf_verbose("SwitchRes: user modeline %s\n", modeline_print(mode, modeline_txt, MS_FULL));
+    json machine_display = get_machine_display_json(machine);
+    t_machine_display display;
+    parse_machine_display(machine_display, &display);
     
-    switchres_get_video_mode(machine);
+    json states_json = machine["states"];
+    std::vector<json> states = states_json.is_null()? std::vector<json>(1, json::object()) : states_json.get<std::vector<json>>();
     
+    machine_instance instance(profile, machine_name, &display);
     
-    json output;
-    modeline *best_mode = &machine.switchres.best_mode;
+    json states_output = json::array();
+    modeline current_mode;
+    t_display_key current_key;
+    int mode_switches = 0;
     
-    if (best_mode->result.weight & R_OUT_OF_RANGE) {
-      output = {
-        {"inRange", false},
-        {"description", "OUT OF RANGE"},
-        {"details", "OUT OF RANGE"},
-      };
-    }
-    else {
-      char description[256] = {'\x00'};
-      sprintf(description, "%s (%dx%d@%.6f)->(%dx%d@%.6f)", machine.switchres.game.orientation?"vertical":"horizontal",
-        machine.switchres.game.width, machine.switchres.game.height, machine.switchres.game.refresh, best_mode->hactive, best_mode->vactive, best_mode->vfreq
+    for (size_t i = 0; i < states.size(); ++i) {
+      json &state = states[i];
+      bool changed = instance.set_state(
+        state["refresh"].is_null()? display.refresh : state["refresh"].get<double>(),
+        state["width"  ].is_null()? display.width   : state["width"  ].get<s32>(),
+        state["height" ].is_null()? display.height  : state["height" ].get<s32>()
       );
+      t_display_key key = instance.key();
       
-      char details[256] = {'\x00'};
-      modeline_result(best_mode, details);
-      
-      char modeline_str[512] = {'\x00'};
-      modeline_print(best_mode, modeline_str, MS_LABEL | MS_PARAMS);
-      
-      output = {
-        {"inRange", true},
-        {"description", description},
-        {"details", details},
-        {"modelineStr", modeline_str},
-        {"vfreqOff",   best_mode->result.weight & R_V_FREQ_OFF ? true : false},
-        {"resStretch", best_mode->result.weight & R_RES_STRETCH? true : false},
-        {"weight",     best_mode->result.weight },
-        {"xScale",     best_mode->result.x_scale},
-        {"yScale",     best_mode->result.y_scale},
-        {"vScale",     best_mode->result.v_scale},
-        {"xDiff",      best_mode->result.x_diff },
-        {"yDiff",      best_mode->result.y_diff },
-        {"vDiff",      best_mode->result.v_diff },
-        {"xRatio",     best_mode->result.x_ratio},
-        {"yRatio",     best_mode->result.y_ratio},
-        {"vRatio",     best_mode->result.v_ratio},
-        {"rotated",    best_mode->result.rotated},
-        {"modeline", {
-          {"pclock",     best_mode->pclock    },
-          {"hactive",    best_mode->hactive   },
-          {"hbegin",     best_mode->hbegin    },
-          {"hend",       best_mode->hend      },
-          {"htotal",     best_mode->htotal    },
-          {"vactive",    best_mode->vactive   },
-          {"vbegin",     best_mode->vbegin    },
-          {"vend",       best_mode->vend      },
-          {"vtotal",     best_mode->vtotal    },
-          {"interlace",  best_mode->interlace },
-          {"doublescan", best_mode->doublescan},
-          {"hsync",      best_mode->hsync     },
-          {"vsync",      best_mode->vsync     },
-          //
-          {"vfreq",      best_mode->vfreq     },
-          {"hfreq",      best_mode->hfreq     },
-          //
-          {"width",      best_mode->width     },
-          {"height",     best_mode->height    },
-          {"refresh",    best_mode->refresh   },
-          //
-          {"type",       best_mode->type      },
-          {"range",      best_mode->range     }
-        }},
-      };
+      if (i == 0 || (changed && !(key == current_key))) {
+        std::map<t_display_key, modeline>::iterator it = modes.find(key);
+        if (it == modes.end()) {
+          const modeline *default_mode = default_results >= 0? lookup_default_result(default_results, &key) : NULL;
+          if (!default_mode) {
+            instance.search(context);
+          }
+          it = modes.insert(std::make_pair(key, default_mode? *default_mode : instance.machine.switchres.best_mode)).first;
+        }
+        
+        bool mode_switch = i > 0 && !same_mode_timing(&current_mode, &it->second);
+        mode_switches += mode_switch;
+        
+        current_mode = it->second;
+        current_key = key;
+        
+        t_machine_result result;
+        instance.get_result(&result);
+        result.best_mode = current_mode;
+        states_output.push_back(serialize_machine_result(&result));
+        states_output.back()["modeSwitch"] = mode_switch;
+      }
+      else {
+        states_output.push_back(states_output.back());
+        states_output.back()["modeSwitch"] = false;
+      }
+      states_output.back()["resolutionChange"] = i > 0 && changed;
     }
     
-    strcpy(machine_output.machine_name, machine_name);
-    machine_output.output = output;
+    machine_output.output = {
+      {"states",       states_output},
+      {"modeSwitches", mode_switches}
+    };
     return machine_output;
   }
   catch(const std::exception& err) {
@@ -255,31 +361,1075 @@ t_machine_output calc_modeline(json config, json machine) {
   }
 }
 
+t_machine_output calc_modeline_err(json machine, const char *err_msg) {
+  t_machine_output machine_output;
+  
+  try {
+    copy_json_str(machine["name"].get<std::string>().c_str(), machine_output.machine_name);
+  } catch(const std::exception& err) {}
+  
+  fprintf(stderr, "err: %s\n", err_msg);
+  machine_output.output = {
+    {"err", err_msg}
+  };
+  return machine_output;
+}
+
+// the EVAL_NO_* mask of a "disable" list
+int parse_disabled_optimizations(json &disable_json) {
+  int disabled = 0;
+  if (disable_json.is_null()) {
+    return disabled;
+  }
+  for (const std::string &name : disable_json.get<std::vector<std::string>>()) {
+    disabled |=
+      name == "lineCache"     ? EVAL_NO_LINE_CACHE      :
+      name == "prefilter"     ? EVAL_NO_PREFILTER       :
+      name == "modeIndex"     ? EVAL_NO_MODE_INDEX      :
+      name == "defaultResults"? EVAL_NO_DEFAULT_RESULTS :
+      throw std::invalid_argument("Invalid optimization to disable: " + name);
+  }
+  return disabled;
+}
+
+// gives the context's worker a ring buffer when tracing is on
+std::unique_ptr<t_trace_thread> attach_tracer(t_eval_context *context, const t_trace_options *options) {
+  if (!options->enabled) {
+    return nullptr;
+  }
+  std::unique_ptr<t_trace_thread> tracer(new t_trace_thread);
+  trace_thread_init(tracer.get(), options);
+  context->tracer = tracer.get();
+  return tracer;
+}
+
+const char *return_json(json &output) {
+  static std::string output_str;
+  output_str = output.dump();
+  return output_str.c_str();
+}
+
+// Like return_json with the output as "machines" and the batch's stats as
+// "stats" of a wrapping object, so a machine can't collide with the stats.
+// The output is dumped first so the stats include its serialization.
+const char *return_json_with_stats(json &output, t_eval_stats *stats, const line_params_cache *line_cache) {
+  static std::string output_str;
+  double start = eval_stats_start(stats);
+  output_str = "{\"machines\":";
+  output_str += output.dump();
+  eval_stats_end(stats, STAGE_SERIALIZE, start);
+  
+  output_str += ",\"stats\":";
+  output_str += serialize_eval_stats(stats, line_cache).dump();
+  output_str += "}";
+  return output_str.c_str();
+}
+
+const char *return_err(const std::exception& err) {
+  fprintf(stderr, "err: %s\n", err.what());
+  json err_json = {
+    {"err", err.what()}
+  };
+  return return_json(err_json);
+}
+
+// decodes the machine and sets it up against the profile to get the inputs
+// the search depends on
+t_display_key get_machine_display_key(t_monitor_profile *profile, json &machine, char *machine_name) {
+  copy_json_str(machine["name"].get<std::string>().c_str(), machine_name);
+  
+  json machine_display = get_machine_display_json(machine);
+  t_machine_display display;
+  parse_machine_display(machine_display, &display);
+  
+  machine_instance instance(profile, machine_name, &display);
+  return instance.key();
+}
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+//
+// With "stats": true the output is {"machines": <the output>, "stats":
+// {...}} with the wall time per stage, the search counters and the peak
+// heap usage (see eval_stats.h).
+//
+// With "trace" the search of the given machines is traced to a file (see
+// trace_file.h), to decode with the trace-decode command. Traced machines
+// are always searched, even with a compiled in result.
+//
+// With "metrics" the latency histograms of the machines and stages are
+// written to that path in the Prometheus text format, or to stderr for "-"
+// so the output stays plain JSON.
+//
+// "disable" turns optimizations off ("lineCache", "prefilter", "modeIndex"
+// and "defaultResults"), their results must be the same as the plain
+// engine's (see test/switchresRegression.cjs).
 const char *calc_modelines(const char *input_json_str) {
   try {
+    // all machines share the same monitor ranges so the horizontal line
+    // params can be reused between them
+    std::unique_ptr<t_eval_context> context(create_eval_context());
+    t_eval_stats *stats = &context->stats;
+    
+    // whether stats are on is only known once the input is parsed
+    double start = eval_stats_now();
     json input = json::parse(input_json_str);
     json config = input["config"];
     std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    json stats_json = input["stats"];
+    std::string metrics_path = input["metrics"].is_null()? "" : input["metrics"].get<std::string>();
+    eval_stats_reset(stats, stats_json.is_boolean() && stats_json.get<bool>(), !metrics_path.empty());
+    t_trace_options trace_options;
+    parse_trace_options(input["trace"], &trace_options);
+    std::unique_ptr<t_trace_thread> tracer = attach_tracer(context.get(), &trace_options);
+    context->disabled = parse_disabled_optimizations(input["disable"]);
+    eval_stats_end(stats, STAGE_PARSE, start);
+    stats->machines = machines.size();
+    
+    // the monitor config is the same for every machine so it is only
+    // parsed and validated once
+    start = eval_stats_start(stats);
+    std::string profile_err;
+    std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile);
+    try {
+      build_monitor_profile(config, profile.get());
+    } catch(const std::exception& err) {
+      profile_err = err.what();
+    }
+    
+    int default_results = profile_err.empty()? find_default_results(profile.get()) : -1;
+    eval_stats_end(stats, STAGE_MONITOR, start);
     
     json output = json::object();
     for (std::vector<json>::iterator it = machines.begin(); it != machines.end(); ++it) {
-      t_machine_output machine_output = calc_modeline(config, *it);
+      start = eval_stats_start(stats);
+      t_machine_output machine_output = profile_err.empty()
+        ? calc_modeline(profile.get(), default_results, *it, context.get())
+        : calc_modeline_err(*it, profile_err.c_str());
+      eval_stats_end_machine(stats, start);
       output[machine_output.machine_name] = machine_output.output;
     }
     
-    return output.dump().c_str();
+    show_eval_context(context.get());
+    
+    if (tracer) {
+      write_trace_file(trace_options.path.c_str(), {tracer.get()});
+    }
+    
+    const char *output_str = stats->enabled
+      ? return_json_with_stats(output, stats, &context->line_cache)
+      : return_json(output);
+    if (!metrics_path.empty()) {
+      write_latency_metrics(metrics_path.c_str(), stats);
+    }
+    return output_str;
     
   } catch(const std::exception& err) {
-    fprintf(stderr, "err: %s\n", err.what());
-    json err_json = {
-      {"err", err.what()}
+    return return_err(err);
+  }
+}
+
+// Like calc_modelines but the machines are split across a pool of
+// "threads" workers (defaults to one per hardware thread, builds without
+// pthreads run on one) and the results are returned as an array in input
+// order. Each worker traces to its own buffer and records its own
+// latency histograms, merged at the end of the batch.
+const char *calc_modelines_bulk(const char *input_json_str) {
+  try {
+    t_eval_stats batch_stats;
+    double start = eval_stats_now();
+    json input = json::parse(input_json_str);
+    json config = input["config"];
+    std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    json threads_json = input["threads"];
+    int workers = parallel_workers(threads_json.is_null()? 0 : threads_json.get<int>());
+    t_trace_options trace_options;
+    parse_trace_options(input["trace"], &trace_options);
+    std::string metrics_path = input["metrics"].is_null()? "" : input["metrics"].get<std::string>();
+    eval_stats_reset(&batch_stats, false, !metrics_path.empty());
+    eval_stats_end(&batch_stats, STAGE_PARSE, start);
+    
+    start = eval_stats_start(&batch_stats);
+    std::string profile_err;
+    std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile);
+    try {
+      build_monitor_profile(config, profile.get());
+    } catch(const std::exception& err) {
+      profile_err = err.what();
+    }
+    
+    int default_results = profile_err.empty()? find_default_results(profile.get()) : -1;
+    eval_stats_end(&batch_stats, STAGE_MONITOR, start);
+    
+    std::vector<std::unique_ptr<t_eval_context>> contexts;
+    std::vector<std::unique_ptr<t_trace_thread>> tracers;
+    for (int i = 0; i < workers; ++i) {
+      contexts.push_back(std::unique_ptr<t_eval_context>(create_eval_context()));
+      contexts.back()->stats.histograms = batch_stats.histograms;
+      tracers.push_back(attach_tracer(contexts.back().get(), &trace_options));
+    }
+    
+    std::vector<json> outputs(machines.size());
+    parallel_for(machines.size(), workers, [&](size_t i, int worker) {
+      t_eval_stats *stats = &contexts[worker]->stats;
+      double machine_start = eval_stats_start(stats);
+      t_machine_output machine_output = profile_err.empty()
+        ? calc_modeline(profile.get(), default_results, machines[i], contexts[worker].get())
+        : calc_modeline_err(machines[i], profile_err.c_str());
+      eval_stats_end_machine(stats, machine_start);
+      outputs[i] = std::move(machine_output.output);
+    });
+    
+    for (std::unique_ptr<t_eval_context> &context : contexts) {
+      show_eval_context(context.get());
+      merge_eval_stats(&batch_stats, &context->stats);
+    }
+    
+    if (trace_options.enabled) {
+      std::vector<const t_trace_thread*> threads;
+      for (std::unique_ptr<t_trace_thread> &tracer : tracers) {
+        threads.push_back(tracer.get());
+      }
+      write_trace_file(trace_options.path.c_str(), threads);
+    }
+    
+    json output = outputs;
+    const char *output_str = return_json(output);
+    if (!metrics_path.empty()) {
+      write_latency_metrics(metrics_path.c_str(), &batch_stats);
+    }
+    return output_str;
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Like calc_modelines but evaluates every machine under each of the given
+// monitor orientation options ("orientations", defaults to horizontal,
+// vertical and rotate) and returns the results per option. The orientation
+// option doesn't change the monitor profile so it is only built once.
+const char *calc_modelines_orientations(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    json config = input["config"];
+    std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    
+    std::vector<std::string> orientations = {"horizontal", "vertical", "rotate"};
+    json orientations_json = input["orientations"];
+    if (!orientations_json.is_null()) {
+      orientations = orientations_json.get<std::vector<std::string>>();
+    }
+    
+    std::string profile_err;
+    std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile);
+    try {
+      build_monitor_profile(config, profile.get());
+    } catch(const std::exception& err) {
+      profile_err = err.what();
+    }
+    
+    // the profile for each option only differs by the orientation
+    std::vector<t_monitor_profile> profiles;
+    std::vector<int> default_results;
+    for (std::vector<std::string>::iterator it = orientations.begin(); it != orientations.end(); ++it) {
+      if (std::find(orientations.begin(), it, *it) != it) continue;
+      
+      t_monitor_profile orientation_profile = *profile;
+      memset(orientation_profile.config.orientation, 0, sizeof(orientation_profile.config.orientation));
+      it->copy(orientation_profile.config.orientation, sizeof(orientation_profile.config.orientation) - 1);
+      
+      profiles.push_back(orientation_profile);
+      default_results.push_back(profile_err.empty()? find_default_results(&orientation_profile) : -1);
+    }
+    
+    std::unique_ptr<t_eval_context> context(create_eval_context());
+    
+    int evaluations = 0;
+    json output = json::object();
+    for (std::vector<json>::iterator it = machines.begin(); it != machines.end(); ++it) {
+      t_machine_output machine_output = profile_err.empty()
+        ? calc_modeline_orientations(profiles, default_results, *it, context.get(), &evaluations)
+        : calc_modeline_err(*it, profile_err.c_str());
+      output[machine_output.machine_name] = machine_output.output;
+    }
+    
+    osd_printf_verbose("SwitchRes: %d evaluations for %d machines x %d orientations\n",
+      evaluations, int(machines.size()), int(profiles.size()));
+    show_eval_context(context.get());
+    
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Like calc_modelines but runs each machine through a sequence of runtime
+// resolution and refresh states, see calc_modeline_timeline.
+const char *calc_timelines(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    json config = input["config"];
+    std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    
+    std::string profile_err;
+    std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile);
+    try {
+      build_monitor_profile(config, profile.get());
+    } catch(const std::exception& err) {
+      profile_err = err.what();
+    }
+    
+    int default_results = profile_err.empty()? find_default_results(profile.get()) : -1;
+    std::unique_ptr<t_eval_context> context(create_eval_context());
+    std::map<t_display_key, modeline> modes;
+    
+    json output = json::object();
+    for (std::vector<json>::iterator it = machines.begin(); it != machines.end(); ++it) {
+      t_machine_output machine_output = profile_err.empty()
+        ? calc_modeline_timeline(profile.get(), default_results, *it, context.get(), modes)
+        : calc_modeline_err(*it, profile_err.c_str());
+      output[machine_output.machine_name] = machine_output.output;
+    }
+    
+    show_eval_context(context.get());
+    
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Builds a compatibility grid for the config. Bounds default to the area
+// covered by the given machines. With "fill": "all" every cell is computed
+// (at most COMPAT_GRID_MAX_FILL), otherwise only the cells the given
+// machines use.
+const char *build_compat_grid(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    json config = input["config"];
+    json machines_json = input["machines"];
+    std::vector<json> machines = machines_json.is_null()? std::vector<json>() : machines_json.get<std::vector<json>>();
+    json fill_json = input["fill"];
+    bool fill_all = !fill_json.is_null() && fill_json.get<std::string>() == "all";
+    
+    std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile);
+    build_monitor_profile(config, profile.get());
+    
+    std::vector<t_display_key> keys;
+    for (std::vector<json>::iterator it = machines.begin(); it != machines.end(); ++it) {
+      char machine_name[256] = {'\x00'};
+      try {
+        keys.push_back(get_machine_display_key(profile.get(), *it, machine_name));
+      } catch(const std::exception& err) {
+        fprintf(stderr, "err: %s: %s\n", machine_name, err.what());
+      }
+    }
+    
+    t_compat_grid_bounds bounds;
+    json bounds_json = input["bounds"];
+    if (!bounds_json.is_null()) {
+      bounds.width_min   = bounds_json["widthMin"  ].get<int>();
+      bounds.width_max   = bounds_json["widthMax"  ].get<int>();
+      bounds.height_min  = bounds_json["heightMin" ].get<int>();
+      bounds.height_max  = bounds_json["heightMax" ].get<int>();
+      bounds.refresh_min = bounds_json["refreshMin"].get<u32>();
+      bounds.refresh_max = bounds_json["refreshMax"].get<u32>();
+    }
+    else {
+      get_compat_grid_bounds(keys, &bounds);
+    }
+    
+    std::unique_ptr<compat_grid> grid(new compat_grid(&bounds));
+    if (fill_all && grid->fill_size() > COMPAT_GRID_MAX_FILL) {
+      throw std::invalid_argument("Grid bounds are too large to fill, the limit is " + std::to_string(COMPAT_GRID_MAX_FILL) + " cells.");
+    }
+    std::unique_ptr<t_eval_context> context(create_eval_context());
+    
+    int filled = fill_compat_grid(grid.get(), profile.get(), fill_all? NULL : &keys, context.get());
+    
+    json output = export_compat_grid(grid.get(), config);
+    output["filled"] = filled;
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Looks up the compatibility of each machine in a grid exported by
+// build_compat_grid. Machines whose cell is off the grid or was not filled
+// are evaluated exactly.
+const char *lookup_compat_grid(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    json config = input["config"];
+    std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    
+    std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile);
+    build_monitor_profile(config, profile.get());
+    
+    std::unique_ptr<compat_grid> grid(import_compat_grid(input["grid"], config));
+    std::unique_ptr<t_eval_context> context(create_eval_context());
+    
+    int grid_hits = 0, exact_evaluations = 0;
+    json results = json::object();
+    for (std::vector<json>::iterator it = machines.begin(); it != machines.end(); ++it) {
+      char machine_name[256] = {'\x00'};
+      try {
+        t_display_key key = get_machine_display_key(profile.get(), *it, machine_name);
+        
+        u8 *cell = grid->cell(&key);
+        bool exact = !cell || !*cell;
+        u8 value = exact? eval_compat_cell(profile.get(), &key, context.get()) : *cell;
+        
+        json result = unpack_compat_cell(value);
+        result["exact"] = exact;
+        results[machine_name] = result;
+        
+        exact? ++exact_evaluations : ++grid_hits;
+      } catch(const std::exception& err) {
+        fprintf(stderr, "err: %s\n", err.what());
+        results[machine_name] = {
+          {"err", err.what()}
+        };
+      }
+    }
+    
+    json output = {
+      {"results",          results          },
+      {"gridHits",         grid_hits        },
+      {"exactEvaluations", exact_evaluations}
     };
-    return err_json.dump().c_str();
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Like calc_modelines but evaluates every machine under each of the option
+// variants in "variants" (objects that change some of the config options,
+// see variant_options) and returns an array of results per machine in
+// variant order.
+const char *calc_modelines_variants(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    json config = input["config"];
+    std::vector<json> variant_configs = input["variants"].get<std::vector<json>>();
+    std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    
+    std::string profile_err;
+    std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile);
+    try {
+      build_monitor_profile(config, profile.get());
+    } catch(const std::exception& err) {
+      profile_err = err.what();
+    }
+    
+    std::vector<t_option_variant> variants(variant_configs.size());
+    for (size_t i = 0; i < variants.size(); ++i) {
+      t_option_variant *variant = &variants[i];
+      variant->default_results = -1;
+      variant->same_as = -1;
+      
+      try {
+        variant->config = config.is_null()? json::object() : config;
+        for (json::iterator it = variant_configs[i].begin(); it != variant_configs[i].end(); ++it) {
+          if (std::find_if(std::begin(variant_options), std::end(variant_options), [&](const char *option) { return it.key() == option; }) == std::end(variant_options)) {
+            throw std::invalid_argument("Variants can only change options.");
+          }
+          variant->config[it.key()] = it.value();
+        }
+        
+        for (size_t j = 0; j < i; ++j) {
+          if (variants[j].err.empty() && variants[j].same_as < 0 && variants[j].config == variant->config) {
+            variant->same_as = j;
+            break;
+          }
+        }
+        if (variant->same_as >= 0) continue;
+        
+        variant->profile.reset(new t_monitor_profile);
+        build_monitor_profile(variant->config, variant->profile.get());
+        variant->default_results = find_default_results(variant->profile.get());
+      } catch(const std::exception& err) {
+        variant->err = err.what();
+      }
+    }
+    
+    // the variants only change options so they all share the ranges
+    std::unique_ptr<t_eval_context> context(create_eval_context());
+    
+    json output = json::object();
+    for (std::vector<json>::iterator it = machines.begin(); it != machines.end(); ++it) {
+      t_machine_output machine_output = profile_err.empty()
+        ? calc_modeline_variants(profile.get(), variants, *it, context.get())
+        : calc_modeline_err(*it, profile_err.c_str());
+      output[machine_output.machine_name] = machine_output.output;
+    }
+    
+    show_eval_context(context.get());
+    
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// decodes every screen of the machine, in order
+void parse_machine_screens(json &machine, std::vector<t_machine_display> &displays) {
+  std::vector<json> machine_displays = get_machine_displays_json(machine);
+  if (machine_displays.empty()) {
+    throw std::invalid_argument("Machine has no display.");
+  }
+  
+  displays.resize(machine_displays.size());
+  for (size_t i = 0; i < machine_displays.size(); ++i) {
+    parse_machine_display(machine_displays[i], &displays[i]);
+  }
+}
+
+// the sorted unique display keys of the screens, machines with the same
+// keys have the same worst screen
+std::vector<t_display_key> get_screen_keys(const t_monitor_profile *profile, const char *machine_name, const std::vector<t_machine_display> &displays) {
+  std::vector<t_display_key> keys;
+  for (const t_machine_display &display : displays) {
+    machine_instance instance(profile, machine_name, &display);
+    keys.push_back(instance.key());
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  return keys;
+}
+
+// decodes the machine displays for a matrix, every screen as the cells are
+// the ones of the worst screen (see get_matrix_cell), a machine that fails
+// is left out of the evaluation and its error reported
+void decode_matrix_machines(std::vector<json> &machines, json &machine_names, json &machine_errs, std::vector<std::vector<t_machine_display>> &displays, std::vector<bool> &decoded) {
+  for (size_t i = 0; i < machines.size(); ++i) {
+    char machine_name[256] = {'\x00'};
+    try {
+      copy_json_str(machines[i]["name"].get<std::string>().c_str(), machine_name);
+      
+      parse_machine_screens(machines[i], displays[i]);
+      decoded[i] = true;
+    } catch(const std::exception& err) {
+      fprintf(stderr, "err: %s\n", err.what());
+      machine_errs[machine_name] = err.what();
+    }
+    machine_names.push_back(machine_name);
+  }
+}
+
+// the cells of a matrix column per machine and a count of each result
+json matrix_monitor_json(const t_matrix_monitor *monitor, const t_matrix_key_set *key_set, size_t machines) {
+  std::vector<u8> cells(machines, 0);
+  int in_range = 0, vfreq_off = 0, res_stretch = 0, out_of_range = 0, errors = 0;
+  for (size_t i = 0; i < machines; ++i) {
+    u8 cell = get_matrix_cell(monitor, key_set, i);
+    cells[i] = cell;
+    
+    if (!cell) ++errors;
+    else if (cell & R_OUT_OF_RANGE) ++out_of_range;
+    else {
+      ++in_range;
+      if (cell & R_V_FREQ_OFF ) ++vfreq_off;
+      if (cell & R_RES_STRETCH) ++res_stretch;
+    }
+  }
+  
+  return {
+    {"summary", {
+      {"inRange",    in_range    },
+      {"vfreqOff",   vfreq_off   },
+      {"resStretch", res_stretch },
+      {"outOfRange", out_of_range},
+      {"errors",     errors      },
+      {"evaluated",  key_set->keys.size()}
+    }},
+    {"cells", base64_encode(cells)}
+  };
+}
+
+// Evaluates every machine against every monitor config in "monitors". Each
+// profile is built once, the machines are decoded once and only the unique
+// display keys are evaluated, in parallel ("threads", defaults to one per
+// hardware thread). For each monitor the result is a string of base64
+// encoded cells, one byte per machine in input order packed like the
+// compat grid cells (0 if the machine failed), plus a count of each result.
+const char *calc_compat_matrix(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    std::vector<json> configs = input["monitors"].get<std::vector<json>>();
+    std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    json threads_json = input["threads"];
+    int threads = threads_json.is_null()? 0 : threads_json.get<int>();
+    
+    json machine_names = json::array();
+    json machine_errs = json::object();
+    std::vector<std::vector<t_machine_display>> displays(machines.size());
+    std::vector<bool> decoded(machines.size(), false);
+    decode_matrix_machines(machines, machine_names, machine_errs, displays, decoded);
+    
+    std::vector<t_matrix_key_set> key_sets;
+    std::vector<t_matrix_monitor> monitors(configs.size());
+    for (size_t m = 0; m < configs.size(); ++m) {
+      t_matrix_monitor *monitor = &monitors[m];
+      monitor->config = configs[m];
+      try {
+        build_monitor_profile(configs[m], &monitor->profile);
+        monitor->default_results = find_default_results(&monitor->profile);
+        monitor->key_set = get_matrix_key_set(key_sets, &monitor->profile, displays, decoded);
+      } catch(const std::exception& err) {
+        monitor->err = err.what();
+      }
+    }
+    
+    fill_compat_matrix(monitors, key_sets, threads);
+    
+    json monitors_json = json::array();
+    for (t_matrix_monitor &monitor : monitors) {
+      if (!monitor.err.empty()) {
+        monitors_json.push_back({
+          {"config", monitor.config},
+          {"err",    monitor.err   }
+        });
+        continue;
+      }
+      
+      json monitor_json = matrix_monitor_json(&monitor, &key_sets[monitor.key_set], machines.size());
+      monitor_json["config"] = monitor.config;
+      monitors_json.push_back(monitor_json);
+    }
+    
+    json output = {
+      {"machines",      machine_names},
+      {"machineErrors", machine_errs },
+      {"monitors",      monitors_json}
+    };
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Evaluates every machine against each user modeline of a list
+// ("modelines", the list text or an array of its lines, and/or
+// "modelinesFile", read natively), one modeline per line as in
+// parse_modeline_list. The rest of the monitor options come from "config".
+// Each modeline is parsed and turned into a range once, then evaluated like
+// a monitor of calc_compat_matrix, in parallel across modelines.
+const char *calc_user_modelines(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    json config = input["config"];
+    std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    json threads_json = input["threads"];
+    int threads = threads_json.is_null()? 0 : threads_json.get<int>();
+    
+    std::vector<t_user_modeline> modelines;
+    json modelines_file_json = input["modelinesFile"];
+    if (!modelines_file_json.is_null()) {
+      parse_modeline_list(read_video_modes_file(modelines_file_json.get<std::string>().c_str()), modelines);
+    }
+    json modelines_json = input["modelines"];
+    if (modelines_json.is_string()) {
+      parse_modeline_list(modelines_json.get<std::string>(), modelines);
+    }
+    else if (!modelines_json.is_null()) {
+      for (const std::string &line : modelines_json.get<std::vector<std::string>>()) {
+        parse_modeline_list(line, modelines);
+      }
+    }
+    
+    json machine_names = json::array();
+    json machine_errs = json::object();
+    std::vector<std::vector<t_machine_display>> displays(machines.size());
+    std::vector<bool> decoded(machines.size(), false);
+    decode_matrix_machines(machines, machine_names, machine_errs, displays, decoded);
+    
+    // the options are validated once with the first modeline, which also
+    // stands in for the monitor preset
+    std::unique_ptr<t_monitor_profile> base_profile(new t_monitor_profile);
+    std::vector<t_user_modeline>::iterator first = std::find_if(modelines.begin(), modelines.end(), [](const t_user_modeline &user_modeline) { return user_modeline.err.empty(); });
+    if (first != modelines.end()) {
+      json base_config = config.is_null()? json::object() : config;
+      base_config["modeline"] = first->text.substr(0, sizeof(base_profile->config.modeline) - 1);
+      build_monitor_profile(base_config, base_profile.get());
+    }
+    
+    std::vector<t_matrix_key_set> key_sets;
+    std::vector<t_matrix_monitor> monitors(modelines.size());
+    for (size_t m = 0; m < modelines.size(); ++m) {
+      t_matrix_monitor *monitor = &monitors[m];
+      monitor->err = modelines[m].err;
+      if (!monitor->err.empty()) continue;
+      
+      monitor->profile = *base_profile;
+      set_user_modeline(&monitor->profile, &modelines[m].mode, modelines[m].text.c_str());
+      monitor->default_results = -1;
+      monitor->key_set = get_matrix_key_set(key_sets, &monitor->profile, displays, decoded);
+    }
+    
+    fill_compat_matrix(monitors, key_sets, threads);
+    
+    json modelines_output = json::array();
+    for (size_t m = 0; m < modelines.size(); ++m) {
+      t_matrix_monitor *monitor = &monitors[m];
+      json modeline_json = monitor->err.empty()
+        ? matrix_monitor_json(monitor, &key_sets[monitor->key_set], machines.size())
+        : json({{"err", monitor->err}});
+      
+      modeline_json["name"]     = modelines[m].name;
+      modeline_json["modeline"] = modelines[m].text;
+      if (monitor->err.empty()) {
+        double params[RANGE_PARAMS];
+        char range_str[256];
+        range_to_params(&monitor->profile.range[0], params);
+        format_range_params(params, range_str);
+        modeline_json["range"] = range_str;
+      }
+      modelines_output.push_back(modeline_json);
+    }
+    
+    json output = {
+      {"machines",      machine_names   },
+      {"machineErrors", machine_errs    },
+      {"modelines",     modelines_output}
+    };
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Searches the custom range that fits the most machines, see
+// t_range_optimizer. "base" is the crt_range the search starts from and
+// that gives the parameters "bounds" doesn't step ([min, max, step]) or fix
+// (a number). Machines can have a "weight" (defaults to 1) and count with
+// their worst screen, as in calc_modeline. Returns the "top" best ranges.
+const char *optimize_custom_range(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    json config = input["config"].is_null()? json::object() : input["config"];
+    std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    json bounds_json = input["bounds"];
+    json top_json = input["top"];
+    json max_candidates_json = input["maxCandidates"];
+    json threads_json = input["threads"];
+    json base_json = input["base"];
+    
+    std::unique_ptr<t_range_optimizer> optimizer(new t_range_optimizer);
+    optimizer->total_weight   = 0;
+    optimizer->top            = top_json.is_null()? 10 : std::max(1, top_json.get<int>());
+    optimizer->max_candidates = max_candidates_json.is_null()? 2000 : max_candidates_json.get<size_t>();
+    optimizer->workers        = threads_json.is_null()? 0 : threads_json.get<int>();
+    
+    std::string base = base_json.is_null()? "15625-15750, 49.50-65.00, 2.000, 4.700, 8.000, 0.064, 0.192, 1.024, 0, 0, 192, 288, 448, 576" : base_json.get<std::string>();
+    parse_range_params(base.c_str(), optimizer->base);
+    
+    // throws if the base range doesn't pass monitor_evaluate_range
+    config["preset"] = "custom";
+    config["ranges"] = json::array({base});
+    build_monitor_profile(config, &optimizer->profile);
+    
+    for (int p = 0; p < RANGE_PARAMS; ++p) {
+      json param_json = bounds_json.is_null()? json() : bounds_json[range_param_names[p]];
+      if (param_json.is_number()) {
+        optimizer->base[p] = param_json.get<double>();
+      }
+      else if (param_json.is_array()) {
+        std::vector<double> bounds = param_json.get<std::vector<double>>();
+        if (bounds.size() != 3 || bounds[2] <= 0 || bounds[1] < bounds[0] || (bounds[1] - bounds[0]) / bounds[2] > 10000) {
+          throw std::invalid_argument("Invalid bounds.");
+        }
+        for (int i = 0; bounds[0] + i * bounds[2] <= bounds[1] + bounds[2] * 1e-9; ++i) {
+          optimizer->values[p].push_back(bounds[0] + i * bounds[2]);
+        }
+      }
+    }
+    
+    json machine_errs = json::object();
+    for (std::vector<json>::iterator it = machines.begin(); it != machines.end(); ++it) {
+      char machine_name[256] = {'\x00'};
+      try {
+        copy_json_str((*it)["name"].get<std::string>().c_str(), machine_name);
+        
+        std::vector<t_machine_display> displays;
+        parse_machine_screens(*it, displays);
+        
+        json weight_json = (*it)["weight"];
+        add_optimizer_key(optimizer.get(), displays, weight_json.is_null()? 1 : weight_json.get<double>());
+      } catch(const std::exception& err) {
+        fprintf(stderr, "err: %s\n", err.what());
+        machine_errs[machine_name] = err.what();
+      }
+    }
+    
+    optimize_range(optimizer.get());
+    
+    json best = json::array();
+    for (t_range_candidate &candidate : optimizer->best) {
+      best.push_back({
+        {"range",   candidate.range   },
+        {"score",   candidate.score   },
+        {"inRange", candidate.in_range}
+      });
+    }
+    
+    json output = {
+      {"best",          best},
+      {"strategy",      optimizer->exhaustive? "exhaustive" : "descent"},
+      {"totalWeight",   optimizer->total_weight},
+      {"keys",          optimizer->keys.size()},
+      {"candidates",    optimizer->candidates},
+      {"evaluated",     optimizer->evaluated},
+      {"invalid",       optimizer->invalid},
+      {"pruned",        optimizer->pruned},
+      {"cacheHits",     optimizer->cache_hits},
+      {"machineErrors", machine_errs}
+    };
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// For each machine and each of the "parameters" ({"range": index, "param":
+// name from range_param_names, "from", "to"}) returns the segments of the
+// parameter's values over which the result flags stay the same, see
+// find_sensitivity_segments. As in calc_modeline the flags are the ones of
+// the machine's worst screen. Machines with the same display keys share the
+// segments.
+const char *calc_sensitivity(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    json config = input["config"];
+    std::vector<json> params_json = input["parameters"].get<std::vector<json>>();
+    std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    
+    std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile);
+    build_monitor_profile(config, profile.get());
+    
+    std::vector<t_sensitivity_param> params;
+    for (json &param_json : params_json) {
+      t_sensitivity_param param;
+      param.range = param_json["range"].is_null()? 0 : param_json["range"].get<int>();
+      param.from  = param_json["from"].get<double>();
+      param.to    = param_json["to"].get<double>();
+      
+      std::string name = param_json["param"].get<std::string>();
+      param.param = std::find(std::begin(range_param_names), std::end(range_param_names), name) - std::begin(range_param_names);
+      
+      if (param.param >= RANGE_PARAMS) {
+        throw std::invalid_argument("Invalid range parameter.");
+      }
+      if (param.range < 0 || param.range >= MAX_RANGES || !profile->range[param.range].hfreq_max) {
+        throw std::invalid_argument("Invalid range index.");
+      }
+      params.push_back(param);
+    }
+    
+    std::map<std::vector<t_display_key>, json> key_segments;
+    json output = json::object();
+    for (std::vector<json>::iterator it = machines.begin(); it != machines.end(); ++it) {
+      char machine_name[256] = {'\x00'};
+      try {
+        copy_json_str((*it)["name"].get<std::string>().c_str(), machine_name);
+        
+        std::vector<t_machine_display> displays;
+        parse_machine_screens(*it, displays);
+        std::vector<t_display_key> keys = get_screen_keys(profile.get(), machine_name, displays);
+        
+        std::map<std::vector<t_display_key>, json>::iterator segments_it = key_segments.find(keys);
+        if (segments_it == key_segments.end()) {
+          json segments_json = json::array();
+          for (t_sensitivity_param &param : params) {
+            std::vector<t_sensitivity_segment> segments;
+            find_sensitivity_segments(profile.get(), &param, displays, segments);
+            
+            json param_segments_json = json::array();
+            for (t_sensitivity_segment &segment : segments) {
+              param_segments_json.push_back({
+                {"value",      segment.value},
+                {"validRange", segment.valid},
+                {"inRange",    segment.valid && !(segment.flags & R_OUT_OF_RANGE)},
+                {"vfreqOff",   segment.flags & R_V_FREQ_OFF ? true : false},
+                {"resStretch", segment.flags & R_RES_STRETCH? true : false}
+              });
+            }
+            segments_json.push_back(param_segments_json);
+          }
+          segments_it = key_segments.insert(std::make_pair(keys, segments_json)).first;
+        }
+        output[machine_name] = segments_it->second;
+      } catch(const std::exception& err) {
+        fprintf(stderr, "err: %s\n", err.what());
+        output[machine_name] = {
+          {"err", err.what()}
+        };
+      }
+    }
+    
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Computes the VESA timings ({"formula": "gtf", "cvt" or "cvt-rb"}) of a
+// list of modes ({"modes": [[width, height, refresh, interlace], ...]},
+// interlace is optional) in one modeline_vesa_batch call. Each modeline is
+// returned packed as an array of the values named by "fields".
+const char *calc_vesa_modelines(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    std::string formula_str = input["formula"].is_null()? "gtf" : input["formula"].get<std::string>();
+    std::vector<json> modes_json = input["modes"].get<std::vector<json>>();
+    
+    int formula =
+      formula_str == "gtf"   ? VESA_GTF    :
+      formula_str == "cvt"   ? VESA_CVT    :
+      formula_str == "cvt-rb"? VESA_CVT_RB :
+      -1;
+    if (formula < 0) {
+      throw std::invalid_argument("Invalid formula.");
+    }
+    
+    std::vector<modeline> modes(modes_json.size());
+    for (size_t i = 0; i < modes_json.size(); ++i) {
+      json &mode_json = modes_json[i];
+      if (!mode_json.is_array() || mode_json.size() < 3) {
+        throw std::invalid_argument("Invalid mode " + std::to_string(i) + ".");
+      }
+      
+      modeline *mode = &modes[i];
+      memset(mode, 0, sizeof(modeline));
+      mode->width     = mode_json[0].get<int>();
+      mode->height    = mode_json[1].get<int>();
+      mode->vfreq     = mode_json[2].get<double>();
+      mode->interlace = mode_json.size() > 3 && (mode_json[3].is_boolean()? mode_json[3].get<bool>() : mode_json[3].get<int>() != 0);
+      if (mode->width < 8 || mode->height < 2 || !(mode->vfreq > 0)) {
+        throw std::invalid_argument("Invalid mode " + std::to_string(i) + ".");
+      }
+    }
+    
+    modeline_vesa_batch(modes.data(), modes.size(), formula);
+    
+    json modelines_json = json::array();
+    for (modeline &mode : modes) {
+      modelines_json.push_back({
+        mode.pclock,
+        mode.hactive, mode.hbegin, mode.hend, mode.htotal,
+        mode.vactive, mode.vbegin, mode.vend, mode.vtotal,
+        mode.interlace, mode.hsync, mode.vsync,
+        mode.hfreq, mode.vfreq
+      });
+    }
+    
+    json output = {
+      {"fields", {
+        "pclock",
+        "hactive", "hbegin", "hend", "htotal",
+        "vactive", "vbegin", "vend", "vtotal",
+        "interlace", "hsync", "vsync",
+        "hfreq", "vfreq"
+      }},
+      {"modelines", modelines_json}
+    };
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Writes the best mode of each machine as a config file ("format": "ini",
+// "xrandr" or "modelist") to "path", or a file per machine in the "path"
+// directory with "split" (native only). Returns the counts, the machines
+// that are out of range and the machine errors.
+const char *export_configs(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    json config = input["config"];
+    std::vector<json> machines = input["machines"].get<std::vector<json>>();
+    std::string format = input["format"].is_null()? "ini" : input["format"].get<std::string>();
+    
+    t_export_options options;
+    options.format =
+      format == "ini"     ? EXPORT_INI      :
+      format == "xrandr"  ? EXPORT_XRANDR   :
+      format == "modelist"? EXPORT_MODELIST :
+      throw std::invalid_argument("Invalid export format.");
+    options.path          = input["path"].get<std::string>();
+    options.split         = input["split"].is_null()? false : input["split"].get<bool>();
+    options.xrandr_output = input["xrandrOutput"].is_null()? "VGA-0" : input["xrandrOutput"].get<std::string>();
+    options.workers       = input["threads"].is_null()? 0 : input["threads"].get<int>();
+    
+    std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile);
+    build_monitor_profile(config, profile.get());
+    int default_results = find_default_results(profile.get());
+    
+    t_export_stats stats;
+    export_machine_configs(profile.get(), default_results, machines, &options, &stats);
+    
+    json output = {
+      {"machines",      stats.machines},
+      {"exported",      stats.exported},
+      {"files",         stats.files},
+      {"outOfRange",    stats.out_of_range},
+      {"machineErrors", stats.machine_errs}
+    };
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Decodes the trace file at "path" written by calc_modelines with "trace",
+// only the records of "machine" if given
+const char *decode_trace(const char *input_json_str) {
+  try {
+    json input = json::parse(input_json_str);
+    std::string path = input["path"].get<std::string>();
+    
+    json output = decode_trace_file(path.c_str());
+    json machine_json = input["machine"];
+    if (!machine_json.is_null()) {
+      json records = output["machines"][machine_json.get<std::string>()];
+      output["machines"] = {
+        {machine_json.get<std::string>(), records.is_null()? json::array() : records}
+      };
+    }
+    return return_json(output);
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
+  }
+}
+
+// Generates default_results.inc from a machine display corpus (native only)
+const char *calc_default_results(const char *input_json_str) {
+  try {
+    json corpus = json::parse(input_json_str);
+    
+    static std::string output_str;
+    output_str = generate_default_results(corpus);
+    return output_str.c_str();
+    
+  } catch(const std::exception& err) {
+    return return_err(err);
   }
 }
 
@@ -290,10 +1440,41 @@ const char *calc_modelines(const char *input_json_str) {
 
 
 int main(int argc, const char **argv) {
-  const char *input_json_str = argc > 1? argv[1] : "";
+  // an optional command selects the entry point
+  const char *command = "calc";
+  if (argc > 1 && (!strcmp(argv[1], "grid-build") || !strcmp(argv[1], "grid-lookup") || !strcmp(argv[1], "default-results") || !strcmp(argv[1], "orientations") || !strcmp(argv[1], "matrix") || !strcmp(argv[1], "variants") || !strcmp(argv[1], "optimize") || !strcmp(argv[1], "sensitivity") || !strcmp(argv[1], "timeline") || !strcmp(argv[1], "modelines") || !strcmp(argv[1], "vesa") || !strcmp(argv[1], "export") || !strcmp(argv[1], "bulk") || !strcmp(argv[1], "trace-decode"))) {
+    command = argv[1];
+    ++argv;
+    --argc;
+  }
+  
+  // read the input from stdin if it is not given as an argument (large
+  // batches do not fit in a single argument)
+  std::string input_json_str;
+  if (argc > 1 && strcmp(argv[1], "-")) {
+    input_json_str = argv[1];
+  }
+  else {
+    input_json_str.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+  }
   
-  const char *output_json_str = calc_modelines(input_json_str);
+  const char *output_json_str =
+    !strcmp(command, "grid-build" )? build_compat_grid (input_json_str.c_str()) :
+    !strcmp(command, "grid-lookup")? lookup_compat_grid(input_json_str.c_str()) :
+    !strcmp(command, "default-results")? calc_default_results(input_json_str.c_str()) :
+    !strcmp(command, "orientations"   )? calc_modelines_orientations(input_json_str.c_str()) :
+    !strcmp(command, "matrix"         )? calc_compat_matrix(input_json_str.c_str()) :
+    !strcmp(command, "variants"       )? calc_modelines_variants(input_json_str.c_str()) :
+    !strcmp(command, "optimize"       )? optimize_custom_range(input_json_str.c_str()) :
+    !strcmp(command, "sensitivity"    )? calc_sensitivity(input_json_str.c_str()) :
+    !strcmp(command, "timeline"       )? calc_timelines(input_json_str.c_str()) :
+    !strcmp(command, "modelines"      )? calc_user_modelines(input_json_str.c_str()) :
+    !strcmp(command, "vesa"           )? calc_vesa_modelines(input_json_str.c_str()) :
+    !strcmp(command, "export"         )? export_configs(input_json_str.c_str()) :
+    !strcmp(command, "bulk"           )? calc_modelines_bulk(input_json_str.c_str()) :
+    !strcmp(command, "trace-decode"   )? decode_trace(input_json_str.c_str()) :
+    calc_modelines(input_json_str.c_str());
   std::cout << output_json_str << "\n";
   
   return 0;
-}
\ No newline at end of file
+}
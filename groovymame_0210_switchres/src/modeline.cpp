@@ -15,6 +15,11 @@
  **************************************************************/
 
 #include "ext.h"
+#include "probes.h"
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
 
 #define max(a,b)({ __typeof__ (a) _a = (a);__typeof__ (b) _b = (b);_a > _b ? _a : _b; })
 #define min(a,b)({ __typeof__ (a) _a = (a);__typeof__ (b) _b = (b);_a < _b ? _a : _b; })
@@ -23,7 +28,6 @@
 //  PROTOTYPES
 //============================================================
 
-int get_line_params(modeline *mode, monitor_range *range);
 int scale_into_range (int value, int lower_limit, int higher_limit);
 int scale_into_range (float value, float lower_limit, float higher_limit);
 int scale_into_aspect (int source_res, int tot_res, float original_monitor_aspect, float users_monitor_aspect, float *best_diff);
@@ -32,6 +36,29 @@ int total_lines_for_yres(int yres, float vfreq, monitor_range *range, float inte
 float max_vfreq_for_yres (int yres, monitor_range *range, float interlace);
 int round_near (double number);
 
+//============================================================
+//  modeline_trace_create
+//============================================================
+
+static void modeline_trace_create(config_settings *cs, modeline *t_mode, int exit, int x_scale, int y_scale, int v_scale, float interlace, float doublescan, int doublings)
+{
+	trace_record record;
+	memset(&record, 0, sizeof(trace_record));
+	record.type = TRACE_CREATE;
+	record.detail = exit;
+	record.mode_flags = (interlace == 2? TRACE_MODE_INTERLACE : 0) | (doublescan != 1? TRACE_MODE_DOUBLESCAN : 0);
+	record.weight = t_mode->result.weight;
+	record.hactive = t_mode->hactive;
+	record.vactive = t_mode->vactive;
+	record.x_scale = x_scale;
+	record.y_scale = y_scale;
+	record.v_scale = v_scale;
+	record.doublings = doublings;
+	record.vfreq = t_mode->vfreq;
+	record.hfreq = t_mode->hfreq;
+	trace_write(cs->trace, &record);
+}
+
 //============================================================
 //  modeline_create
 //============================================================
@@ -53,6 +80,10 @@ int modeline_create(modeline *s_mode, modeline *t_mode, monitor_range *range, co
 	float v_diff = 0;
 	float y_ratio = 0;
 	float x_ratio = 0;
+	int line_iterations = 0;
+	int doublings = 0;
+
+	if (cs->search_stats) cs->search_stats->modeline_creates++;
 
 	// init all editable fields with source or user values
 	if (t_mode->type & X_RES_EDITABLE)
@@ -84,6 +115,7 @@ int modeline_create(modeline *s_mode, modeline *t_mode, monitor_range *range, co
 	else if (v_scale != 1 && !(t_mode->type & V_FREQ_EDITABLE))
 	{
 		t_mode->result.weight |= R_OUT_OF_RANGE;
+		if (cs->trace) modeline_trace_create(cs, t_mode, TRACE_EXIT_VFREQ, x_scale, y_scale, v_scale, interlace, doublescan, doublings);
 		return -1;
 	}
 
@@ -115,6 +147,7 @@ int modeline_create(modeline *s_mode, modeline *t_mode, monitor_range *range, co
 		if (vfreq_real != vfreq * v_scale && !(t_mode->type & V_FREQ_EDITABLE))
 		{
 			t_mode->result.weight |= R_OUT_OF_RANGE;
+			if (cs->trace) modeline_trace_create(cs, t_mode, TRACE_EXIT_VFREQ_YRES, x_scale, y_scale, v_scale, interlace, doublescan, doublings);
 			return -1;
 		}
 
@@ -162,6 +195,7 @@ int modeline_create(modeline *s_mode, modeline *t_mode, monitor_range *range, co
 	else
 	{
 		t_mode->result.weight |= R_OUT_OF_RANGE;
+		if (cs->trace) modeline_trace_create(cs, t_mode, TRACE_EXIT_YRES, x_scale, y_scale, v_scale, interlace, doublescan, doublings);
 		return -1;
 	}
 
@@ -248,7 +282,11 @@ int modeline_create(modeline *s_mode, modeline *t_mode, monitor_range *range, co
 		horizontal_values:
 
 		// Fill horizontal part of modeline
-		get_line_params(t_mode, range);
+		if (cs->line_cache)
+			line_iterations = get_line_params_cached(t_mode, range, cs->line_cache);
+		else
+			line_iterations = get_line_params(t_mode, range);
+		if (cs->search_stats) cs->search_stats->line_params_iterations += line_iterations;
 
 		// Calculate pixel clock
 		t_mode->pclock = t_mode->htotal * t_mode->hfreq;
@@ -258,11 +296,13 @@ int modeline_create(modeline *s_mode, modeline *t_mode, monitor_range *range, co
 			{
 				x_scale *= 2;
 				t_mode->hactive *= 2;
+				doublings++;
 				goto horizontal_values;
 			}
 			else
 			{
 				t_mode->result.weight |= R_OUT_OF_RANGE;
+				if (cs->trace) modeline_trace_create(cs, t_mode, TRACE_EXIT_PCLOCK, x_scale, y_scale, v_scale, interlace, doublescan, doublings);
 				return -1;
 			}
 		}
@@ -295,11 +335,95 @@ int modeline_create(modeline *s_mode, modeline *t_mode, monitor_range *range, co
 	t_mode->result.v_ratio = 0;
 	t_mode->result.rotated = cs->effective_orientation;
 
+	if (cs->trace) modeline_trace_create(cs, t_mode, TRACE_EXIT_DONE, x_scale, y_scale, v_scale, interlace, doublescan, doublings);
+
+	return 0;
+}
+
+//============================================================
+//  modeline_prefilter
+//  Conservative check that replays the early exits of
+//  modeline_create with the same types and comparisons.
+//  Returns 1 only if modeline_create would return out of
+//  range for this range. Editable refresh is always brought
+//  into range and editable height falls back to stretching,
+//  so only fixed modes can be rejected. It doesn't depend on
+//  the source mode, so a video mode table is checked once.
+//============================================================
+
+int modeline_prefilter(modeline *t_mode, monitor_range *range, config_settings *cs)
+{
+	float vfreq = 0;
+	float interlace = 1;
+	int yres = 0;
+	int y_scale = 0;
+	bool v_editable = t_mode->type & V_FREQ_EDITABLE;
+
+	if (!v_editable)
+	{
+		vfreq = t_mode->vfreq;
+		if (scale_into_range(vfreq, range->vfreq_min, range->vfreq_max) != 1)
+			return 1;
+	}
+
+	if ((t_mode->type & Y_RES_EDITABLE) && !cs->height)
+		return 0;
+
+	yres = (t_mode->type & Y_RES_EDITABLE)? cs->height : t_mode->vactive;
+
+	if (range->progressive_lines_min && (!t_mode->interlace || v_editable))
+		y_scale = scale_into_range(yres, range->progressive_lines_min, range->progressive_lines_max);
+
+	if (!y_scale && range->interlaced_lines_min && cs->interlace && (t_mode->interlace || v_editable))
+	{
+		y_scale = scale_into_range(yres, range->interlaced_lines_min, range->interlaced_lines_max);
+		interlace = 2;
+	}
+
+	// a fixed height must fit the range unscaled
+	if (y_scale != 1)
+		return 1;
+
+	// a fixed refresh must be achievable with this height
+	if (!v_editable && max_vfreq_for_yres(yres, range, interlace) < vfreq)
+		return 1;
+
+	return 0;
+}
+
+//============================================================
+//  modeline_refresh_off
+//  For a mode with nothing editable, whether modeline_create
+//  would flag R_V_FREQ_OFF for the source in any range it
+//  doesn't reject. Such a mode keeps its own vfreq, so this
+//  replays the same types and comparisons without a range.
+//============================================================
+
+int modeline_refresh_off(modeline *s_mode, modeline *t_mode, config_settings *cs)
+{
+	float vfreq_real = t_mode->vfreq;
+	int v_scale = max(round_near(vfreq_real / s_mode->vfreq), 1);
+	float v_diff = (vfreq_real / v_scale) -  s_mode->vfreq;
+
+	return fabs(v_diff) > cs->sync_refresh_tolerance;
+}
+
+//============================================================
+//  prefilter_stats_show
+//============================================================
+
+int prefilter_stats_show(prefilter_stats *stats)
+{
+	osd_printf_verbose("SwitchRes: Prefilter %llu ranges checked, %llu rejected (%.2f%%)\n",
+		(unsigned long long)stats->evaluated, (unsigned long long)stats->rejected,
+		stats->evaluated? double(stats->rejected) / stats->evaluated * 100 : 0.0);
+
 	return 0;
 }
 
 //============================================================
 //  get_line_params
+//  Returns the number of iterations it took to converge
 //============================================================
 
 int get_line_params(modeline *mode, monitor_range *range)
@@ -308,6 +432,7 @@ int get_line_params(modeline *mode, monitor_range *range)
 	int hh, hs, he, ht;
 	float line_time, char_time, new_char_time;
 	float hfront_porch_min, hsync_pulse_min, hback_porch_min;
+	int iterations = 0;
 
 	hfront_porch_min = range->hfront_porch * .90;
 	hsync_pulse_min  = range->hsync_pulse  * .90;
@@ -318,7 +443,45 @@ int get_line_params(modeline *mode, monitor_range *range)
 	hh = round(mode->hactive / 8);
 	hs = he = ht = 1;
 
+#ifdef __wasm_simd128__
+	// Fit hs, he and ht in lanes 0 to 2 at once. The porch distances are
+	// compared as doubles like below so the result is the same
+	v128_t porch_min = wasm_f32x4_make(hfront_porch_min, hsync_pulse_min, hback_porch_min, 0);
+	v128_t porch_lo = wasm_f64x2_make(range->hfront_porch, range->hsync_pulse);
+	v128_t porch_hi = wasm_f64x2_make(range->hback_porch, 0);
+	v128_t chars = wasm_i32x4_make(hs, he, ht, 0);
+
+	new_char_time = line_time / (hh + hs + he + ht);
 	do {
+		iterations++;
+		char_time = new_char_time;
+
+		v128_t chars_f = wasm_f32x4_convert_i32x4(chars);
+		v128_t time = wasm_f32x4_splat(char_time);
+		v128_t cur = wasm_f32x4_mul(chars_f, time);
+		v128_t next = wasm_f32x4_mul(wasm_f32x4_add(chars_f, wasm_f32x4_splat(1)), time);
+		v128_t cur_hi = wasm_i32x4_shuffle(cur, cur, 2, 3, 2, 3);
+		v128_t next_hi = wasm_i32x4_shuffle(next, next, 2, 3, 2, 3);
+
+		v128_t closer_lo = wasm_f64x2_lt(
+			wasm_f64x2_abs(wasm_f64x2_sub(wasm_f64x2_promote_low_f32x4(next), porch_lo)),
+			wasm_f64x2_abs(wasm_f64x2_sub(wasm_f64x2_promote_low_f32x4(cur), porch_lo)));
+		v128_t closer_hi = wasm_f64x2_lt(
+			wasm_f64x2_abs(wasm_f64x2_sub(wasm_f64x2_promote_low_f32x4(next_hi), porch_hi)),
+			wasm_f64x2_abs(wasm_f64x2_sub(wasm_f64x2_promote_low_f32x4(cur_hi), porch_hi)));
+
+		// all ones in the lanes that grow
+		v128_t grow = wasm_v128_or(wasm_f32x4_lt(cur, porch_min), wasm_i32x4_shuffle(closer_lo, closer_hi, 0, 2, 4, 6));
+		chars = wasm_i32x4_sub(chars, grow);
+
+		hs = wasm_i32x4_extract_lane(chars, 0);
+		he = wasm_i32x4_extract_lane(chars, 1);
+		ht = wasm_i32x4_extract_lane(chars, 2);
+		new_char_time = line_time / (hh + hs + he + ht);
+	} while (new_char_time != char_time);
+#else
+	do {
+		iterations++;
 		char_time = line_time / (hh + hs + he + ht);
 		if (hs * char_time < hfront_porch_min ||
 			fabs((hs + 1) * char_time - range->hfront_porch) < fabs(hs * char_time - range->hfront_porch))
@@ -334,6 +497,7 @@ int get_line_params(modeline *mode, monitor_range *range)
 
 		new_char_time = line_time / (hh + hs + he + ht);
 	} while (new_char_time != char_time);
+#endif
 
 	hhi = (hh + hs) * 8;
 	hhf = (hh + hs + he) * 8;
@@ -343,6 +507,102 @@ int get_line_params(modeline *mode, monitor_range *range)
 	mode->hend    = hhf;
 	mode->htotal  = hht;
 
+	return iterations;
+}
+
+//============================================================
+//  get_line_params_cached
+//  The horizontal values only depend on hactive, the line
+//  period and the range porches, so they are memoized per
+//  range index. The line period is keyed as the same float
+//  get_line_params works with, so any hfreq that maps to it
+//  gives exactly the uncached result. The porches are part
+//  of the key too, so a cache used with a changed range
+//  table misses instead of returning stale values (resetting
+//  it when the ranges change only keeps it from filling up
+//  with dead entries). Returns the get_line_params
+//  iterations, 0 on a hit.
+//============================================================
+
+int get_line_params_cached(modeline *mode, monitor_range *range, line_params_cache *cache)
+{
+	line_params_entry *entry, *slot = 0;
+	float line_time = 1 / mode->hfreq * 1000000;
+	uint32_t line_bits, hash;
+	int i;
+
+	memcpy(&line_bits, &line_time, sizeof(line_bits));
+	hash = (line_bits * 0x9e3779b1u) ^ (uint32_t(mode->hactive) * 0x85ebca6bu) ^ (uint32_t(mode->range) * 0xc2b2ae35u);
+	hash ^= hash >> 15;
+
+	cache->lookups++;
+
+	for (i = 0; i < LINE_PARAMS_CACHE_PROBE; i++)
+	{
+		entry = &cache->entry[(hash + i) & (LINE_PARAMS_CACHE_SIZE - 1)];
+
+		if (!entry->used)
+		{
+			slot = entry;
+			break;
+		}
+
+		if (entry->range == mode->range && entry->hactive == mode->hactive && entry->line_time == line_time &&
+			entry->hfront_porch == range->hfront_porch && entry->hsync_pulse == range->hsync_pulse && entry->hback_porch == range->hback_porch)
+		{
+			cache->hits++;
+			SWITCHRES_PROBE2(line__cache, mode->range, 1);
+			mode->hbegin = entry->hbegin;
+			mode->hend   = entry->hend;
+			mode->htotal = entry->htotal;
+			return 0;
+		}
+	}
+
+	// probe sequence is full, replace the home slot
+	if (!slot)
+	{
+		slot = &cache->entry[hash & (LINE_PARAMS_CACHE_SIZE - 1)];
+		cache->evictions++;
+	}
+
+	SWITCHRES_PROBE2(line__cache, mode->range, 0);
+	int iterations = get_line_params(mode, range);
+
+	slot->used = true;
+	slot->range = mode->range;
+	slot->hactive = mode->hactive;
+	slot->line_time = line_time;
+	slot->hfront_porch = range->hfront_porch;
+	slot->hsync_pulse = range->hsync_pulse;
+	slot->hback_porch = range->hback_porch;
+	slot->hbegin = mode->hbegin;
+	slot->hend = mode->hend;
+	slot->htotal = mode->htotal;
+
+	return iterations;
+}
+
+//============================================================
+//  line_params_cache_reset
+//============================================================
+
+void line_params_cache_reset(line_params_cache *cache)
+{
+	memset(cache, 0, sizeof(struct line_params_cache));
+}
+
+//============================================================
+//  line_params_cache_show
+//============================================================
+
+int line_params_cache_show(line_params_cache *cache)
+{
+	osd_printf_verbose("SwitchRes: Line params cache %llu lookups, %llu hits (%.2f%%), %llu evictions\n",
+		(unsigned long long)cache->lookups, (unsigned long long)cache->hits,
+		cache->lookups? double(cache->hits) / cache->lookups * 100 : 0.0,
+		(unsigned long long)cache->evictions);
+
 	return 0;
 }
 
@@ -531,10 +791,81 @@ int modeline_compare(modeline *t, modeline *best)
 
 //============================================================
 //  modeline_vesa_gtf
-//  Based on the VESA GTF spreadsheet by Andy Morrish 1/5/97
 //============================================================
 
 int modeline_vesa_gtf(modeline *m)
+{
+	return modeline_vesa_batch(m, 1, VESA_GTF);
+}
+
+//============================================================
+//  modeline_vesa_cvt
+//============================================================
+
+int modeline_vesa_cvt(modeline *m, int reduced_blanking)
+{
+	return modeline_vesa_batch(m, 1, reduced_blanking? VESA_CVT_RB : VESA_CVT);
+}
+
+//============================================================
+//  modeline_vesa_batch
+//  Computes the GTF, CVT or CVT reduced blanking timings of
+//  count modes given by width, height, vfreq (or refresh)
+//  and interlace. Modes are gathered into arrays VESA_BATCH
+//  at a time so each formula is a plain loop over them.
+//  We're assuming input vfreq is the total field vfreq
+//  regardless interlace. Returns 0 for an unknown formula,
+//  leaving the modes untouched, 1 otherwise.
+//============================================================
+
+static void vesa_gtf_batch(int n, const int *width, const int *height, const double *vfreq, const int *interlaced, modeline *out);
+static void vesa_cvt_batch(int n, const int *width, const int *height, const double *vfreq, const int *interlaced, modeline *out);
+static void vesa_cvt_rb_batch(int n, const int *width, const int *height, const double *vfreq, const int *interlaced, modeline *out);
+
+int modeline_vesa_batch(modeline *modes, int count, int formula)
+{
+	int width[VESA_BATCH], height[VESA_BATCH], interlaced[VESA_BATCH];
+	double vfreq[VESA_BATCH];
+
+	if (formula != VESA_GTF && formula != VESA_CVT && formula != VESA_CVT_RB)
+		return 0;
+
+	for (int first = 0; first < count; first += VESA_BATCH)
+	{
+		int n = min(count - first, VESA_BATCH);
+		modeline *m = &modes[first];
+
+		for (int i = 0; i < n; i++)
+		{
+			width[i] = m[i].width;
+			height[i] = m[i].height;
+			vfreq[i] = m[i].vfreq? m[i].vfreq:float(m[i].refresh);
+			interlaced[i] = m[i].interlace;
+		}
+
+		switch (formula)
+		{
+			case VESA_GTF:
+				vesa_gtf_batch(n, width, height, vfreq, interlaced, m);
+				break;
+			case VESA_CVT:
+				vesa_cvt_batch(n, width, height, vfreq, interlaced, m);
+				break;
+			case VESA_CVT_RB:
+				vesa_cvt_rb_batch(n, width, height, vfreq, interlaced, m);
+				break;
+		}
+	}
+
+	return 1;
+}
+
+//============================================================
+//  vesa_gtf_batch
+//  Based on the VESA GTF spreadsheet by Andy Morrish 1/5/97
+//============================================================
+
+static void vesa_gtf_batch(int n, const int *width, const int *height, const double *vfreq, const int *interlaced, modeline *out)
 {
 	int C, M;
 	int v_sync_lines, v_porch_lines_min, v_front_porch_lines, v_back_porch_lines, v_sync_v_back_porch_lines, v_total_lines;
@@ -543,9 +874,6 @@ int modeline_vesa_gtf(modeline *m)
 	float h_freq, h_period, h_period_real, h_ideal_blanking;
 	float pixel_freq, interlace;
 
-	// Check if there's a value defined for vfreq. We're assuming input vfreq is the total field vfreq regardless interlace
-	v_freq = m->vfreq? m->vfreq:float(m->refresh);
-
 	// These values are GTF defined defaults
 	v_sync_lines = 3;
 	v_porch_lines_min = 1;
@@ -555,39 +883,166 @@ int modeline_vesa_gtf(modeline *m)
 	M = 128.0 / 256 * 600;
 	C = ((40 - 20) * 128.0 / 256) + 20;
 
-	// GTF calculation
-	interlace = m->interlace?0.5:0;
-	h_period = ((1.0 / v_freq) - (v_sync_v_back_porch / 1000000)) / ((float)m->height + v_front_porch_lines + interlace) * 1000000;
-	v_sync_v_back_porch_lines = round_near(v_sync_v_back_porch / h_period);
-	v_back_porch_lines = v_sync_v_back_porch_lines - v_sync_lines;
-	v_total_lines = m->height + v_front_porch_lines + v_sync_lines + v_back_porch_lines;
-	v_freq_est = (1.0 / h_period) / v_total_lines * 1000000;
-	h_period_real = h_period / (v_freq / v_freq_est);
-	v_freq_real = (1.0 / h_period_real) / v_total_lines * 1000000;
-	h_ideal_blanking = float(C - (M * h_period_real / 1000));
-	h_blanking_pixels = round_near(m->width * h_ideal_blanking /(100 - h_ideal_blanking) / (2 * 8)) * (2 * 8);
-	h_total_pixels = m->width + h_blanking_pixels;
-	pixel_freq = h_total_pixels / h_period_real * 1000000;
-	h_freq = 1000000 / h_period_real;
-	h_sync_width_pixels = round_near(h_sync_width_percent * h_total_pixels / 100 / 8) * 8;
-	h_front_porch_pixels = (h_blanking_pixels / 2) - h_sync_width_pixels;
-
-	// Results
-	m->hactive = m->width;
+	for (int i = 0; i < n; i++)
+	{
+		modeline *m = &out[i];
+		v_freq = vfreq[i];
+
+		// GTF calculation
+		interlace = interlaced[i]?0.5:0;
+		h_period = ((1.0 / v_freq) - (v_sync_v_back_porch / 1000000)) / ((float)height[i] + v_front_porch_lines + interlace) * 1000000;
+		v_sync_v_back_porch_lines = round_near(v_sync_v_back_porch / h_period);
+		v_back_porch_lines = v_sync_v_back_porch_lines - v_sync_lines;
+		v_total_lines = height[i] + v_front_porch_lines + v_sync_lines + v_back_porch_lines;
+		v_freq_est = (1.0 / h_period) / v_total_lines * 1000000;
+		h_period_real = h_period / (v_freq / v_freq_est);
+		v_freq_real = (1.0 / h_period_real) / v_total_lines * 1000000;
+		h_ideal_blanking = float(C - (M * h_period_real / 1000));
+		h_blanking_pixels = round_near(width[i] * h_ideal_blanking /(100 - h_ideal_blanking) / (2 * 8)) * (2 * 8);
+		h_total_pixels = width[i] + h_blanking_pixels;
+		pixel_freq = h_total_pixels / h_period_real * 1000000;
+		h_freq = 1000000 / h_period_real;
+		h_sync_width_pixels = round_near(h_sync_width_percent * h_total_pixels / 100 / 8) * 8;
+		h_front_porch_pixels = (h_blanking_pixels / 2) - h_sync_width_pixels;
+
+		// Results
+		m->hactive = width[i];
+		m->hbegin = m->hactive + h_front_porch_pixels;
+		m->hend = m->hbegin + h_sync_width_pixels;
+		m->htotal = h_total_pixels;
+		m->vactive = height[i];
+		m->vbegin = m->vactive + v_front_porch_lines;
+		m->vend = m->vbegin + v_sync_lines;
+		m->vtotal = v_total_lines;
+		m->hfreq = h_freq;
+		m->vfreq = v_freq_real;
+		m->pclock = pixel_freq;
+		m->hsync = 0;
+		m->vsync = 1;
+	}
+}
+
+//============================================================
+//  vesa_cvt_v_sync
+//  CVT encodes the aspect ratio in the vertical sync width
+//============================================================
+
+static inline int vesa_cvt_v_sync(int width, int height)
+{
+	if (!(height % 3) && height * 4 / 3 == width) return 4;
+	if (!(height % 9) && height * 16 / 9 == width) return 5;
+	if (!(height % 10) && height * 16 / 10 == width) return 6;
+	if (!(height % 4) && height * 5 / 4 == width) return 7;
+	if (!(height % 9) && height * 15 / 9 == width) return 7;
+	return 10;
+}
+
+//============================================================
+//  vesa_cvt_results
+//  Common part of both CVT formulas, the vertical values
+//  are given per field and scaled to the frame here
+//============================================================
+
+static inline void vesa_cvt_results(modeline *m, int width, int height, int interlaced, int h_front_porch_pixels, int h_sync_width_pixels, int h_total_pixels,
+	int v_front_porch_lines, int v_sync_lines, float v_total_lines, int pixel_freq_khz)
+{
+	int field_lines = interlaced? 2 : 1;
+
+	m->hactive = width;
 	m->hbegin = m->hactive + h_front_porch_pixels;
 	m->hend = m->hbegin + h_sync_width_pixels;
 	m->htotal = h_total_pixels;
-	m->vactive = m->height;
-	m->vbegin = m->vactive + v_front_porch_lines;
-	m->vend = m->vbegin + v_sync_lines;
-	m->vtotal = v_total_lines;
-	m->hfreq = h_freq;
-	m->vfreq = v_freq_real;
-	m->pclock = pixel_freq;
-	m->hsync = 0;
-	m->vsync = 1;
+	m->vactive = height;
+	m->vbegin = m->vactive + v_front_porch_lines * field_lines;
+	m->vend = m->vbegin + v_sync_lines * field_lines;
+	m->vtotal = round_near(v_total_lines * field_lines);
+	m->pclock = (uint64_t)pixel_freq_khz * 1000;
+	m->hfreq = double(m->pclock) / m->htotal;
+	m->vfreq = m->hfreq / m->vtotal * field_lines;
+}
 
-	return true;
+//============================================================
+//  vesa_cvt_batch
+//  Based on the VESA CVT 1.2 spreadsheet, CRT timings
+//============================================================
+
+static void vesa_cvt_batch(int n, const int *width, const int *height, const double *vfreq, const int *interlaced, modeline *out)
+{
+	// These values are CVT defined defaults
+	const int cell_granularity = 8;
+	const int v_front_porch_lines = 3;
+	const int v_back_porch_lines_min = 6;
+	const int h_sync_width_percent = 8;
+	const int clock_step_khz = 250;
+	const double v_sync_v_back_porch = 550;
+	const double C = ((40 - 20) * 128.0 / 256) + 20;
+	const double M = 128.0 / 256 * 600;
+
+	for (int i = 0; i < n; i++)
+	{
+		int h_active = width[i] - width[i] % cell_granularity;
+		int v_active = interlaced[i]? height[i] / 2 : height[i];
+		double interlace = interlaced[i]? 0.5 : 0;
+		int v_sync_lines = vesa_cvt_v_sync(h_active, height[i]);
+
+		double h_period = (1000000.0 / vfreq[i] - v_sync_v_back_porch) / (v_active + v_front_porch_lines + interlace);
+		int v_sync_v_back_porch_lines = max(int(v_sync_v_back_porch / h_period) + 1, v_sync_lines + v_back_porch_lines_min);
+		double v_total_lines = v_active + v_sync_v_back_porch_lines + interlace + v_front_porch_lines;
+
+		double h_ideal_blanking = max(C - M * h_period / 1000, 20.0);
+		int h_blanking_pixels = int(h_active * h_ideal_blanking / (100 - h_ideal_blanking));
+		h_blanking_pixels -= h_blanking_pixels % (2 * cell_granularity);
+		int h_total_pixels = h_active + h_blanking_pixels;
+		int pixel_freq_khz = int(h_total_pixels * 1000.0 / h_period);
+		pixel_freq_khz -= pixel_freq_khz % clock_step_khz;
+		int h_sync_width_pixels = h_total_pixels * h_sync_width_percent / 100;
+		h_sync_width_pixels -= h_sync_width_pixels % cell_granularity;
+		int h_front_porch_pixels = h_blanking_pixels / 2 - h_sync_width_pixels;
+
+		vesa_cvt_results(&out[i], h_active, height[i], interlaced[i], h_front_porch_pixels, h_sync_width_pixels, h_total_pixels,
+			v_front_porch_lines, v_sync_lines, v_total_lines, pixel_freq_khz);
+		out[i].hsync = 0;
+		out[i].vsync = 1;
+	}
+}
+
+//============================================================
+//  vesa_cvt_rb_batch
+//  Based on the VESA CVT 1.2 spreadsheet, reduced blanking
+//============================================================
+
+static void vesa_cvt_rb_batch(int n, const int *width, const int *height, const double *vfreq, const int *interlaced, modeline *out)
+{
+	// These values are CVT defined defaults
+	const int cell_granularity = 8;
+	const int v_front_porch_lines = 3;
+	const int v_back_porch_lines_min = 6;
+	const int h_blanking_pixels = 160;
+	const int h_sync_width_pixels = 32;
+	const int clock_step_khz = 250;
+	const double v_blanking_min = 460;
+
+	for (int i = 0; i < n; i++)
+	{
+		int h_active = width[i] - width[i] % cell_granularity;
+		int v_active = interlaced[i]? height[i] / 2 : height[i];
+		double interlace = interlaced[i]? 0.5 : 0;
+		int v_sync_lines = vesa_cvt_v_sync(h_active, height[i]);
+
+		double h_period = (1000000.0 / vfreq[i] - v_blanking_min) / v_active;
+		int v_blanking_lines = max(int(v_blanking_min / h_period) + 1, v_front_porch_lines + v_sync_lines + v_back_porch_lines_min);
+		double v_total_lines = v_active + interlace + v_blanking_lines;
+
+		int h_total_pixels = h_active + h_blanking_pixels;
+		int pixel_freq_khz = int(h_total_pixels * 1000.0 / h_period);
+		pixel_freq_khz -= pixel_freq_khz % clock_step_khz;
+		int h_front_porch_pixels = h_blanking_pixels / 2 - h_sync_width_pixels;
+
+		vesa_cvt_results(&out[i], h_active, height[i], interlaced[i], h_front_porch_pixels, h_sync_width_pixels, h_total_pixels,
+			v_front_porch_lines, v_sync_lines, v_total_lines, pixel_freq_khz);
+		out[i].hsync = 1;
+		out[i].vsync = 0;
+	}
 }
 
 //============================================================
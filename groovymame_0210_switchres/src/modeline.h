@@ -40,6 +40,12 @@
 #define MODELINE_UPDATE      0x004
 #define MODELINE_UPDATE_LIST 0x008 
 
+// VESA timing formulas
+#define VESA_GTF     0
+#define VESA_CVT     1
+#define VESA_CVT_RB  2
+#define VESA_BATCH   64
+
 // Mode types  
 #define MODE_OK         0x00000000
 #define MODE_DESKTOP    0x10000000
@@ -56,6 +62,10 @@
 
 #define XRANDR_TIMING      0x00000020
 
+// Line params cache (size must be a power of 2)
+#define LINE_PARAMS_CACHE_SIZE  4096
+#define LINE_PARAMS_CACHE_PROBE 8
+
 //============================================================
 //  TYPE DEFINITIONS
 //============================================================
@@ -105,16 +115,61 @@ typedef struct modeline
 	mode_result result;
 } modeline;
 
+typedef struct line_params_entry
+{
+	bool   used;
+	int    range;
+	int    hactive;
+	float  line_time;
+	double hfront_porch;
+	double hsync_pulse;
+	double hback_porch;
+	int    hbegin;
+	int    hend;
+	int    htotal;
+} line_params_entry;
+
+typedef struct prefilter_stats
+{
+	uint64_t evaluated;
+	uint64_t rejected;
+} prefilter_stats;
+
+typedef struct search_stats
+{
+	uint64_t ranges;
+	uint64_t modeline_creates;
+	uint64_t line_params_iterations;
+	uint64_t modeline_compares;
+} search_stats;
+
+typedef struct line_params_cache
+{
+	line_params_entry entry[LINE_PARAMS_CACHE_SIZE];
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t evictions;
+} line_params_cache;
+
 //============================================================
 //  PROTOTYPES
 //============================================================
 
 int modeline_create(modeline *s_mode, modeline *t_mode, monitor_range *range, config_settings *cs);
+int modeline_prefilter(modeline *t_mode, monitor_range *range, config_settings *cs);
+int modeline_refresh_off(modeline *s_mode, modeline *t_mode, config_settings *cs);
+int prefilter_stats_show(prefilter_stats *stats);
 int modeline_compare(modeline *t_mode, modeline *best_mode);
 char * modeline_print(modeline *mode, char *modeline, int flags);
 char * modeline_result(modeline *mode, char *result);
 int modeline_vesa_gtf(modeline *m);
+int modeline_vesa_cvt(modeline *m, int reduced_blanking);
+int modeline_vesa_batch(modeline *modes, int count, int formula);
 int modeline_parse(const char *user_modeline, modeline *mode);
 int modeline_to_monitor_range(monitor_range *range, modeline *mode);
+int get_line_params(modeline *mode, monitor_range *range);
+int get_line_params_cached(modeline *mode, monitor_range *range, line_params_cache *cache);
+void line_params_cache_reset(line_params_cache *cache);
+int line_params_cache_show(line_params_cache *cache);
 
 #endif
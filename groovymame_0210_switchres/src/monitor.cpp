@@ -106,6 +106,11 @@ int monitor_fill_lcd_range(monitor_range *range, const char *specs_line)
 //  monitor_fill_vesa_gtf
 //============================================================
 
+static const int vesa_lines[][2] = {{384, 480}, {480, 600}, {600, 768}, {768, 1024}};
+
+static void monitor_vesa_mode(modeline *mode, int lines_max);
+static void monitor_fill_vesa_mode(monitor_range *range, int lines_min, modeline *mode);
+
 int monitor_fill_vesa_gtf(monitor_range *range, const char *max_lines)
 {
 	int lines = 0;
@@ -114,17 +119,20 @@ int monitor_fill_vesa_gtf(monitor_range *range, const char *max_lines)
 	if (!lines)
 		return 0;
 
-	int i = 0;
-	if (lines >= 480)
-		i += monitor_fill_vesa_range(&range[i], 384, 480);
-	if (lines >= 600)
-		i += monitor_fill_vesa_range(&range[i], 480, 600);
-	if (lines >= 768)
-		i += monitor_fill_vesa_range(&range[i], 600, 768);
-	if (lines >= 1024)
-		i += monitor_fill_vesa_range(&range[i], 768, 1024);
-
-	return i;
+	// Compute the GTF modes of all the ranges in one go
+	modeline modes[4];
+	int n = 0;
+	while (n < 4 && lines >= vesa_lines[n][1])
+	{
+		monitor_vesa_mode(&modes[n], vesa_lines[n][1]);
+		n++;
+	}
+	modeline_vesa_batch(modes, n, VESA_GTF);
+
+	for (int i = 0; i < n; i++)
+		monitor_fill_vesa_mode(&range[i], vesa_lines[i][0], &modes[i]);
+
+	return n;
 }
 
 //============================================================
@@ -134,23 +142,33 @@ int monitor_fill_vesa_gtf(monitor_range *range, const char *max_lines)
 int monitor_fill_vesa_range(monitor_range *range, int lines_min, int lines_max)
 {
 	modeline mode;
-	memset(&mode, 0, sizeof(modeline));
+	monitor_vesa_mode(&mode, lines_max);
+	modeline_vesa_gtf(&mode);
+	monitor_fill_vesa_mode(range, lines_min, &mode);
+
+	return 1;
+}
+
+static void monitor_vesa_mode(modeline *mode, int lines_max)
+{
+	memset(mode, 0, sizeof(modeline));
 
-	mode.width = real_res(STANDARD_CRT_ASPECT * lines_max);
-	mode.height = lines_max;
-	mode.refresh = 60;
+	mode->width = real_res(STANDARD_CRT_ASPECT * lines_max);
+	mode->height = lines_max;
+	mode->refresh = 60;
+}
+
+static void monitor_fill_vesa_mode(monitor_range *range, int lines_min, modeline *mode)
+{
 	range->vfreq_min = 50;
 	range->vfreq_max = 65;
 
-	modeline_vesa_gtf(&mode);
-	modeline_to_monitor_range(range, &mode);
+	modeline_to_monitor_range(range, mode);
 
 	range->progressive_lines_min = lines_min;
-	range->hfreq_min = mode.hfreq - 500;
-	range->hfreq_max = mode.hfreq + 500;
+	range->hfreq_min = mode->hfreq - 500;
+	range->hfreq_max = mode->hfreq + 500;
 	monitor_show_range(range);
-
-	return 1;
 }
 
 //============================================================
@@ -171,6 +189,20 @@ int monitor_show_range(monitor_range *range)
 	return 0;
 }
 
+//============================================================
+//  monitor_presets
+//  Every type known by monitor_set_preset
+//============================================================
+
+const char *const monitor_presets[] =
+{
+	"pal", "ntsc", "generic_15", "arcade_15", "arcade_15ex", "arcade_25", "arcade_31",
+	"arcade_15_25", "arcade_15_31", "arcade_15_25_31", "m2929", "d9800", "d9400", "d9200",
+	"k7000", "k7131", "m3129", "h9110", "polo", "pstar", "ms2930", "ms929", "r666b",
+	"pc_31_120", "pc_70_120", "vesa_480", "vesa_600", "vesa_768", "vesa_1024"
+};
+const int monitor_preset_count = sizeof(monitor_presets) / sizeof(monitor_presets[0]);
+
 //============================================================
 //  monitor_set_preset
 //============================================================
@@ -51,6 +51,13 @@ typedef struct monitor_range
 	double vertical_blank;
 } monitor_range;
 
+//============================================================
+//  PRESETS
+//============================================================
+
+extern const char *const monitor_presets[];
+extern const int monitor_preset_count;
+
 //============================================================
 //  PROTOTYPES
 //============================================================
@@ -0,0 +1,69 @@
+#include "parallel.h"
+#include <exception>
+#include <vector>
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define PARALLEL_SERIAL
+#endif
+
+#ifndef PARALLEL_SERIAL
+#include <atomic>
+#include <mutex>
+#include <thread>
+#endif
+
+int parallel_workers(int workers) {
+#ifdef PARALLEL_SERIAL
+  return 1;
+#else
+  if (workers < 1) {
+    workers = std::thread::hardware_concurrency();
+  }
+  return workers < 1? 1 : workers;
+#endif
+}
+
+void parallel_for(size_t count, int workers, const std::function<void(size_t, int)> &fn) {
+  workers = parallel_workers(workers);
+  if (size_t(workers) > count) {
+    workers = count;
+  }
+
+  if (workers <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i, 0);
+    }
+    return;
+  }
+
+#ifndef PARALLEL_SERIAL
+  std::atomic<size_t> next(0);
+  std::exception_ptr err;
+  std::mutex err_mutex;
+
+  auto run = [&](int worker) {
+    for (size_t i = next++; i < count; i = next++) {
+      try {
+        fn(i, worker);
+      } catch(...) {
+        std::lock_guard<std::mutex> lock(err_mutex);
+        if (!err) err = std::current_exception();
+        next = count;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int worker = 1; worker < workers; ++worker) {
+    threads.push_back(std::thread(run, worker));
+  }
+  run(0);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  if (err) {
+    std::rethrow_exception(err);
+  }
+#endif
+}
@@ -0,0 +1,15 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <cstddef>
+#include <functional>
+
+// Runs fn(index, worker) for every index in [0, count) on up to `workers`
+// threads (0 for one per hardware thread). Indexes are handed out in order
+// as workers become free, and `worker` identifies the thread so callers can
+// keep per worker state. The first exception thrown by fn is rethrown once
+// every worker is done. Builds without thread support run serially.
+void parallel_for(size_t count, int workers, const std::function<void(size_t, int)> &fn);
+int parallel_workers(int workers);
+
+#endif // __PARALLEL_H__
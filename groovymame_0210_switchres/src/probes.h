@@ -0,0 +1,33 @@
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+// Static user space probes (USDT) for perf and bpftrace, provider
+// "switchres":
+//   machine__start(name)        calc_modeline, before the first screen
+//   machine__end(name, flags)   calc_modeline, the R_* flags of the worst
+//                               screen or -1 on error
+//   default__result(name, hit)  a compiled in result lookup
+//   range(name, range, weight)  a range evaluated by modeline_create
+//   best(name, range, weight)   the best mode of a search
+//   line__cache(range, hit)     a horizontal line params cache lookup
+// Names are C strings. With sys/sdt.h a probe is a nop and an ELF note,
+// without it (or with SWITCHRES_NO_PROBES) probes are compiled out.
+
+#if !defined(SWITCHRES_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SWITCHRES_PROBES 1
+#endif
+#endif
+
+#ifdef SWITCHRES_PROBES
+#define SWITCHRES_PROBE1(name, a)       DTRACE_PROBE1(switchres, name, a)
+#define SWITCHRES_PROBE2(name, a, b)    DTRACE_PROBE2(switchres, name, a, b)
+#define SWITCHRES_PROBE3(name, a, b, c) DTRACE_PROBE3(switchres, name, a, b, c)
+#else
+#define SWITCHRES_PROBE1(name, a)       do {} while (0)
+#define SWITCHRES_PROBE2(name, a, b)    do {} while (0)
+#define SWITCHRES_PROBE3(name, a, b, c) do {} while (0)
+#endif
+
+#endif // __PROBES_H__
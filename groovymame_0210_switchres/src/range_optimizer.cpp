@@ -0,0 +1,252 @@
+#include "range_optimizer.h"
+#include "parallel.h"
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+const char *const range_param_names[RANGE_PARAMS] = {
+  "hfreqMin", "hfreqMax", "vfreqMin", "vfreqMax",
+  "hfrontPorch", "hsyncPulse", "hbackPorch",
+  "vfrontPorch", "vsyncPulse", "vbackPorch",
+  "hsyncPolarity", "vsyncPolarity",
+  "progressiveLinesMin", "progressiveLinesMax",
+  "interlacedLinesMin", "interlacedLinesMax"
+};
+
+void parse_range_params(const char *range_str, double *params) {
+  int e = sscanf(range_str, "%lf-%lf,%lf-%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf",
+    &params[0], &params[1], &params[2], &params[3],
+    &params[4], &params[5], &params[6], &params[7], &params[8], &params[9],
+    &params[10], &params[11], &params[12], &params[13], &params[14], &params[15]
+  );
+  if (e != RANGE_PARAMS) {
+    throw std::invalid_argument("Invalid range.");
+  }
+}
+
+// the inverse of monitor_fill_range
+void range_to_params(const monitor_range *range, double *params) {
+  params[0]  = range->hfreq_min;
+  params[1]  = range->hfreq_max;
+  params[2]  = range->vfreq_min;
+  params[3]  = range->vfreq_max;
+  params[4]  = range->hfront_porch;
+  params[5]  = range->hsync_pulse;
+  params[6]  = range->hback_porch;
+  params[7]  = range->vfront_porch * 1000;
+  params[8]  = range->vsync_pulse * 1000;
+  params[9]  = range->vback_porch * 1000;
+  params[10] = range->hsync_polarity;
+  params[11] = range->vsync_polarity;
+  params[12] = range->progressive_lines_min;
+  params[13] = range->progressive_lines_max;
+  params[14] = range->interlaced_lines_min;
+  params[15] = range->interlaced_lines_max;
+}
+
+// the smallest step format_range_params can represent
+double range_param_resolution(int param) {
+  return param < 4? 0.01 : param < 10? 0.001 : 1;
+}
+
+// same precision as monitor_show_range
+void format_range_params(const double *params, char *range_str) {
+  sprintf(range_str, "%.2f-%.2f,%.2f-%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%d,%d,%d,%d,%d,%d",
+    params[0], params[1], params[2], params[3],
+    params[4], params[5], params[6], params[7], params[8], params[9],
+    int(params[10]), int(params[11]), int(params[12]), int(params[13]), int(params[14]), int(params[15])
+  );
+}
+
+void add_optimizer_key(t_range_optimizer *optimizer, const std::vector<t_machine_display> &displays, double weight) {
+  t_optimizer_key optimizer_key;
+  for (const t_machine_display &display : displays) {
+    machine_instance instance(&optimizer->profile, "", &display);
+    t_display_key key = instance.key();
+
+    std::vector<t_display_key>::iterator it = std::lower_bound(optimizer_key.keys.begin(), optimizer_key.keys.end(), key);
+    if (it != optimizer_key.keys.end() && *it == key) continue;
+    optimizer_key.displays.insert(optimizer_key.displays.begin() + (it - optimizer_key.keys.begin()), display);
+    optimizer_key.keys.insert(it, key);
+  }
+  optimizer_key.weight = weight;
+  optimizer->total_weight += weight;
+
+  for (t_optimizer_key &other : optimizer->keys) {
+    if (other.keys == optimizer_key.keys) {
+      other.weight += weight;
+      return;
+    }
+  }
+  optimizer->keys.push_back(optimizer_key);
+}
+
+static bool better_candidate(const t_range_candidate &a, const t_range_candidate &b) {
+  return a.score != b.score? a.score > b.score : a.order < b.order;
+}
+
+// the score a candidate has to exceed to still matter for the best list
+static double best_threshold(t_range_optimizer *optimizer) {
+  std::lock_guard<std::mutex> lock(optimizer->mutex);
+  if (optimizer->best.size() < size_t(optimizer->top)) {
+    return -std::numeric_limits<double>::infinity();
+  }
+  return optimizer->best.back().score;
+}
+
+static void eval_range_candidate(t_range_optimizer *optimizer, t_range_candidate *candidate, double floor, t_eval_context *context) {
+  {
+    std::lock_guard<std::mutex> lock(optimizer->mutex);
+    std::map<std::string, t_range_candidate>::iterator it = optimizer->cache.find(candidate->range);
+    if (it != optimizer->cache.end()) {
+      size_t order = candidate->order;
+      *candidate = it->second;
+      candidate->order = order;
+      ++optimizer->cache_hits;
+      return;
+    }
+  }
+
+  std::unique_ptr<t_monitor_profile> profile(new t_monitor_profile(optimizer->profile));
+  memset(profile->config.ranges, 0, sizeof(profile->config.ranges));
+  memset(profile->range, 0, sizeof(profile->range));
+  strcpy(profile->config.ranges[0], candidate->range);
+
+  candidate->valid = candidate->complete = false;
+  candidate->score = candidate->in_range = 0;
+  try {
+    // runs monitor_evaluate_range on the candidate
+    monitor_fill_range(&profile->range[0], candidate->range);
+    index_video_modes(profile.get());
+    candidate->valid = true;
+  } catch(const std::exception& err) {}
+
+  if (candidate->valid) {
+    line_params_cache_reset(&context->line_cache);
+
+    double remaining = optimizer->total_weight;
+    candidate->complete = true;
+    for (t_optimizer_key &key : optimizer->keys) {
+      if (candidate->score + remaining < std::min(floor, best_threshold(optimizer))) {
+        candidate->complete = false;
+        break;
+      }
+
+      int weight = 0;
+      for (t_machine_display &display : key.displays) {
+        machine_instance instance(profile.get(), "", &display);
+        instance.search(context);
+        weight = std::max(weight, instance.machine.switchres.best_mode.result.weight);
+      }
+      if (!(weight & R_OUT_OF_RANGE)) {
+        candidate->in_range += key.weight;
+        if (!(weight & (R_V_FREQ_OFF | R_RES_STRETCH))) {
+          candidate->score += key.weight;
+        }
+      }
+      remaining -= key.weight;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(optimizer->mutex);
+  optimizer->cache[candidate->range] = *candidate;
+  ++optimizer->evaluated;
+  if (!candidate->valid) ++optimizer->invalid;
+  else if (!candidate->complete) ++optimizer->pruned;
+  else {
+    std::vector<t_range_candidate> *best = &optimizer->best;
+    best->insert(std::upper_bound(best->begin(), best->end(), *candidate, better_candidate), *candidate);
+    if (best->size() > size_t(optimizer->top)) {
+      best->pop_back();
+    }
+  }
+}
+
+static void eval_range_candidates(t_range_optimizer *optimizer, std::vector<t_range_candidate> &candidates, double floor, std::vector<std::unique_ptr<t_eval_context>> &contexts) {
+  for (t_range_candidate &candidate : candidates) {
+    candidate.order = optimizer->candidates++;
+  }
+
+  parallel_for(candidates.size(), contexts.size(), [&](size_t i, int worker) {
+    eval_range_candidate(optimizer, &candidates[i], floor, contexts[worker].get());
+  });
+}
+
+void optimize_range(t_range_optimizer *optimizer) {
+  optimizer->candidates = optimizer->evaluated = optimizer->invalid = optimizer->pruned = optimizer->cache_hits = 0;
+  optimizer->best.clear();
+  optimizer->cache.clear();
+
+  // the heaviest keys first so the pruning kicks in as early as possible
+  std::stable_sort(optimizer->keys.begin(), optimizer->keys.end(), [](const t_optimizer_key &a, const t_optimizer_key &b) {
+    return a.weight > b.weight;
+  });
+
+  std::vector<std::unique_ptr<t_eval_context>> contexts;
+  for (int i = parallel_workers(optimizer->workers); i > 0; --i) {
+    contexts.push_back(std::unique_ptr<t_eval_context>(create_eval_context()));
+  }
+
+  size_t grid_size = 1;
+  for (int p = 0; p < RANGE_PARAMS; ++p) {
+    grid_size = optimizer->values[p].empty()? grid_size : std::min(grid_size * optimizer->values[p].size(), optimizer->max_candidates + 1);
+  }
+  optimizer->exhaustive = grid_size <= optimizer->max_candidates;
+
+  if (optimizer->exhaustive) {
+    std::vector<t_range_candidate> candidates(grid_size);
+    for (size_t i = 0; i < grid_size; ++i) {
+      double params[RANGE_PARAMS];
+      size_t index = i;
+      for (int p = 0; p < RANGE_PARAMS; ++p) {
+        const std::vector<double> &values = optimizer->values[p];
+        params[p] = values.empty()? optimizer->base[p] : values[index % values.size()];
+        index = values.empty()? index : index / values.size();
+      }
+      format_range_params(params, candidates[i].range);
+    }
+
+    eval_range_candidates(optimizer, candidates, std::numeric_limits<double>::infinity(), contexts);
+    return;
+  }
+
+  // coordinate descent: sweep one parameter at a time and move to the best
+  // value found, until a whole round doesn't move
+  double current[RANGE_PARAMS];
+  memcpy(current, optimizer->base, sizeof(current));
+
+  std::vector<t_range_candidate> candidates(1);
+  format_range_params(current, candidates[0].range);
+  eval_range_candidates(optimizer, candidates, -std::numeric_limits<double>::infinity(), contexts);
+  t_range_candidate current_candidate = candidates[0];
+  double current_score = current_candidate.valid? current_candidate.score : -1;
+
+  for (int round = 0; round < RANGE_OPTIMIZER_MAX_ROUNDS; ++round) {
+    bool moved = false;
+
+    for (int p = 0; p < RANGE_PARAMS; ++p) {
+      const std::vector<double> &values = optimizer->values[p];
+      if (values.empty()) continue;
+
+      candidates.assign(values.size(), t_range_candidate());
+      for (size_t v = 0; v < values.size(); ++v) {
+        double params[RANGE_PARAMS];
+        memcpy(params, current, sizeof(params));
+        params[p] = values[v];
+        format_range_params(params, candidates[v].range);
+      }
+
+      eval_range_candidates(optimizer, candidates, current_score, contexts);
+
+      for (size_t v = 0; v < values.size(); ++v) {
+        if (candidates[v].valid && candidates[v].complete && candidates[v].score > current_score) {
+          current_score = candidates[v].score;
+          current[p] = values[v];
+          moved = true;
+        }
+      }
+    }
+
+    if (!moved) break;
+  }
+}
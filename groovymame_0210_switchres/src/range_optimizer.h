@@ -0,0 +1,75 @@
+#ifndef __RANGE_OPTIMIZER_H__
+#define __RANGE_OPTIMIZER_H__
+
+#include "engine.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// the 16 fields of a crt_range string, in order
+#define RANGE_PARAMS 16
+
+#define RANGE_OPTIMIZER_MAX_ROUNDS 16
+
+extern const char *const range_param_names[RANGE_PARAMS];
+
+// the sorted unique display keys of a machine's screens and the total
+// weight of the machines that have them, a machine counts with its worst
+// screen as in calc_modeline
+typedef struct t_optimizer_key {
+  std::vector<t_display_key>     keys;
+  std::vector<t_machine_display> displays; // a display producing each key
+  double                         weight;
+} t_optimizer_key;
+
+typedef struct t_range_candidate {
+  size_t order;                // evaluation order, breaks ties
+  char   range[MAX_RANGE_LEN];
+  bool   valid;                // passed monitor_evaluate_range
+  bool   complete;             // false if the evaluation was pruned
+  double score;                // weight in range, integer scaled and on refresh
+  double in_range;             // weight in range
+} t_range_candidate;
+
+// Searches the custom range (as a single crt_range) that maximizes the
+// weighted count of machines that are in range, integer scaled and on
+// refresh. Each parameter is either fixed or stepped over [min, max]. The
+// whole grid is searched when it has at most max_candidates points,
+// otherwise a coordinate descent starts from the base range.
+//
+// A candidate is abandoned as soon as the weight it has left to evaluate
+// can't get it past both the current best candidates and (when descending)
+// the current point, so pruning never changes the result. Scores are
+// cached by range string since the descent revisits the same points.
+typedef struct t_range_optimizer {
+  t_monitor_profile            profile; // the custom range is replaced per candidate
+  std::vector<t_optimizer_key> keys;
+  double                       total_weight;
+  double                       base[RANGE_PARAMS];
+  std::vector<double>          values[RANGE_PARAMS];
+  int                          top;
+  int                          workers;
+  size_t                       max_candidates;
+
+  // results
+  bool                           exhaustive;
+  std::vector<t_range_candidate> best;
+  size_t                         candidates;
+  size_t                         evaluated;
+  size_t                         invalid;
+  size_t                         pruned;
+  size_t                         cache_hits;
+
+  std::map<std::string, t_range_candidate> cache;
+  std::mutex                               mutex;
+} t_range_optimizer;
+
+void parse_range_params(const char *range_str, double *params);
+void range_to_params(const monitor_range *range, double *params);
+double range_param_resolution(int param);
+void format_range_params(const double *params, char *range_str);
+void add_optimizer_key(t_range_optimizer *optimizer, const std::vector<t_machine_display> &displays, double weight);
+void optimize_range(t_range_optimizer *optimizer);
+
+#endif // __RANGE_OPTIMIZER_H__
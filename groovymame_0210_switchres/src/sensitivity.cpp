@@ -0,0 +1,197 @@
+#include "sensitivity.h"
+#include "range_optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+
+// evaluates the machine with the parameter at from + step * resolution,
+// screens with the same display key are evaluated once
+class sensitivity_search {
+  public:
+    const t_sensitivity_param *param;
+    double resolution;
+    long steps;
+    double params[RANGE_PARAMS];
+    std::unique_ptr<t_monitor_profile> profile;
+    std::vector<std::unique_ptr<machine_instance>> instances;
+    std::map<long, int> results;
+
+    sensitivity_search(const t_monitor_profile *base_profile, const t_sensitivity_param *p_param, const std::vector<t_machine_display> &displays)
+    : param(p_param),
+      profile(new t_monitor_profile(*base_profile))
+    {
+      resolution = range_param_resolution(param->param);
+      steps = std::max(0L, long(floor((param->to - param->from) / resolution + 0.5)));
+      range_to_params(&profile->range[param->range], params);
+      for (const t_machine_display &display : displays) {
+        std::unique_ptr<machine_instance> instance(new machine_instance(profile.get(), "", &display));
+        t_display_key key = instance->key();
+        if (std::none_of(instances.begin(), instances.end(), [&](const std::unique_ptr<machine_instance> &other) { return other->key() == key; })) {
+          instances.push_back(std::move(instance));
+        }
+      }
+    }
+
+    double value(long step) const {
+      return param->from + step * resolution;
+    }
+
+    long step(double value) const {
+      return std::min(steps, std::max(0L, long(floor((value - param->from) / resolution))));
+    }
+
+    // the result flags of the worst screen, or -1 if the range is invalid
+    int eval(long step) {
+      std::map<long, int>::iterator it = results.find(step);
+      if (it != results.end()) {
+        return it->second;
+      }
+
+      char range_str[MAX_RANGE_LEN];
+      params[param->param] = value(step);
+      format_range_params(params, range_str);
+
+      int result = -1;
+      try {
+        monitor_fill_range(&profile->range[param->range], range_str);
+        index_video_modes(profile.get());
+
+        // the range changes every time so there is nothing to memoize
+        int worst = 0;
+        for (std::unique_ptr<machine_instance> &instance : instances) {
+          instance->set_profile(profile.get());
+          instance->search(NULL);
+          worst = std::max(worst, instance->machine.switchres.best_mode.result.weight & (R_OUT_OF_RANGE | R_V_FREQ_OFF | R_RES_STRETCH));
+        }
+        result = worst;
+      } catch(const std::exception& err) {}
+
+      results[step] = result;
+      return result;
+    }
+
+    // evaluates steps between a and b until every change is pinned down to
+    // two consecutive steps
+    void bisect(long a, int result_a, long b, int result_b) {
+      if (result_a == result_b || b - a < 2) return;
+
+      long mid = a + (b - a) / 2;
+      int result_mid = eval(mid);
+      bisect(a, result_a, mid, result_mid);
+      bisect(mid, result_mid, b, result_b);
+    }
+};
+
+// values where the result may change, from the inequalities modeline_create
+// checks
+static void get_candidate_values(const t_monitor_profile *profile, const t_sensitivity_param *param, const t_display_key *key, std::vector<double> &values) {
+  const monitor_range *range = &profile->range[param->range];
+  double refresh = key->refresh;
+  double tolerance = profile->cs.sync_refresh_tolerance;
+  int lines = key->vactive;
+
+  std::vector<double> vfreqs;
+  for (int k = 1; k <= 4; ++k) {
+    vfreqs.push_back(k * refresh);
+    vfreqs.push_back(k * (refresh - tolerance));
+    vfreqs.push_back(k * (refresh + tolerance));
+  }
+
+  switch (param->param) {
+    case 2: case 3: // vfreq_min, vfreq_max
+      values.insert(values.end(), vfreqs.begin(), vfreqs.end());
+      break;
+
+    case 12: case 13: case 14: case 15: // line limits
+      for (int k = 1; k <= 16; ++k) {
+        values.push_back(lines * k);
+        values.push_back(lines * k + 1);
+      }
+      break;
+
+    case 0: case 1: // hfreq_max / (yres / interlace + hfreq_max * vertical_blank) = vfreq
+      for (double vfreq : vfreqs) {
+        if (vfreq * range->vertical_blank >= 1) continue;
+        for (int interlace = 1; interlace <= 2; ++interlace) {
+          for (int k = 1; k <= 16; ++k) {
+            values.push_back(vfreq * lines * k / interlace / (1 - vfreq * range->vertical_blank));
+          }
+        }
+      }
+      break;
+
+    case 4: case 5: case 6: // htotal * hfreq = pclock_min solved for the horizontal blanking
+      if (profile->cs.pclock_min <= 0) break;
+      for (int h = 0; h <= 8; ++h) {
+        double hfreq = range->hfreq_min + (range->hfreq_max - range->hfreq_min) * h / 8;
+        if (hfreq <= 0) continue;
+        double line_time = 1000000 / hfreq;
+        // x doublings bring an editable width over the minimum
+        for (int k = 0; k <= 4; ++k) {
+          double horizontal_blank = line_time - double(key->hactive << k) * 1000000 / profile->cs.pclock_min;
+          values.push_back(horizontal_blank - (range->hfront_porch + range->hsync_pulse + range->hback_porch) + (
+            param->param == 4? range->hfront_porch :
+            param->param == 5? range->hsync_pulse  :
+                               range->hback_porch
+          ));
+        }
+      }
+      break;
+
+    case 7: case 8: case 9: // the same solved for the vertical blanking
+      for (double vfreq : vfreqs) {
+        for (int interlace = 1; interlace <= 2; ++interlace) {
+          for (int k = 1; k <= 16; ++k) {
+            double vertical_blank = (range->hfreq_max / vfreq - double(lines) * k / interlace) / range->hfreq_max;
+            values.push_back((vertical_blank - range->vertical_blank) * 1000 + (
+              param->param == 7? range->vfront_porch :
+              param->param == 8? range->vsync_pulse  :
+                                 range->vback_porch
+            ) * 1000);
+          }
+        }
+      }
+      break;
+  }
+}
+
+void find_sensitivity_segments(const t_monitor_profile *profile, const t_sensitivity_param *param, const std::vector<t_machine_display> &displays, std::vector<t_sensitivity_segment> &segments) {
+  sensitivity_search search(profile, param, displays);
+
+  std::vector<double> values;
+  for (std::unique_ptr<machine_instance> &instance : search.instances) {
+    t_display_key key = instance->key();
+    get_candidate_values(profile, param, &key, values);
+  }
+
+  std::vector<long> steps;
+  for (int i = 0; i <= SENSITIVITY_SAMPLES; ++i) {
+    steps.push_back(search.steps * i / SENSITIVITY_SAMPLES);
+  }
+  for (double value : values) {
+    if (!std::isfinite(value)) continue;
+    steps.push_back(search.step(value));
+    steps.push_back(std::min(search.steps, search.step(value) + 1));
+  }
+  std::sort(steps.begin(), steps.end());
+  steps.erase(std::unique(steps.begin(), steps.end()), steps.end());
+
+  for (size_t i = 0; i < steps.size(); ++i) {
+    search.eval(steps[i]);
+  }
+  for (size_t i = 1; i < steps.size(); ++i) {
+    search.bisect(steps[i - 1], search.results[steps[i - 1]], steps[i], search.results[steps[i]]);
+  }
+
+  segments.clear();
+  for (std::map<long, int>::iterator it = search.results.begin(); it != search.results.end(); ++it) {
+    if (!segments.empty() && (segments.back().valid? segments.back().flags : -1) == it->second) continue;
+
+    t_sensitivity_segment segment;
+    segment.value = search.value(it->first);
+    segment.valid = it->second >= 0;
+    segment.flags = segment.valid? it->second : 0;
+    segments.push_back(segment);
+  }
+}
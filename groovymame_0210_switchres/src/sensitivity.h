@@ -0,0 +1,41 @@
+#ifndef __SENSITIVITY_H__
+#define __SENSITIVITY_H__
+
+#include "engine.h"
+#include <vector>
+
+#define SENSITIVITY_SAMPLES 64
+
+// a range parameter swept over [from, to]
+typedef struct t_sensitivity_param {
+  int    range; // index of the profile range
+  int    param; // index into range_param_names
+  double from;
+  double to;
+} t_sensitivity_param;
+
+// the result from `value` on, up to the next segment
+typedef struct t_sensitivity_segment {
+  double value;
+  bool   valid; // the range passes monitor_evaluate_range
+  int    flags; // R_OUT_OF_RANGE, R_V_FREQ_OFF and R_RES_STRETCH of the best mode
+                // of the worst screen, as in calc_modeline
+} t_sensitivity_segment;
+
+// Finds the values of the parameter at which the machine's result flags
+// change, at the resolution a crt_range string can express. The candidate
+// values follow from the inequalities of modeline_create (the line limits
+// against multiples of the source height, the refresh range against
+// multiples of the source refresh and the sync tolerance,
+// max_vfreq_for_yres solved for hfreq_max and the vertical blanking, and
+// the dot clock minimum solved for the horizontal blanking), plus evenly
+// spaced samples. Every change between two evaluated values is then
+// bisected with the exact engine, so the thresholds match what a full
+// evaluation at that value gives. A change and its reversal between the
+// same two evaluated values can't be seen though: a segment narrower than
+// the sample spacing is only found if a candidate value falls in it. The
+// horizontal porch candidates are approximate (the porches are rounded to
+// character clocks), so that is most likely for them.
+void find_sensitivity_segments(const t_monitor_profile *profile, const t_sensitivity_param *param, const std::vector<t_machine_display> &displays, std::vector<t_sensitivity_segment> &segments);
+
+#endif // __SENSITIVITY_H__
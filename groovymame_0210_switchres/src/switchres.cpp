@@ -15,15 +15,256 @@
  **************************************************************/
 
 #include "ext.h"
+#include "probes.h"
 
 #define CUSTOM_VIDEO_TIMING_SYSTEM      0x00000010
 
+#define ALL_RANGES ((1 << MAX_RANGES) - 1)
+
 //============================================================
 //  PROTOTYPES
 //============================================================
 
 void set_option(running_machine &machine, const char *option_ID, bool state);
 
+//============================================================
+//  switchres_trace_mode
+//============================================================
+
+static void switchres_trace_mode(config_settings *cs, int type, int detail, modeline *mode)
+{
+	trace_record record;
+	memset(&record, 0, sizeof(trace_record));
+	record.type = type;
+	record.detail = detail;
+	record.mode_flags = (mode->interlace? TRACE_MODE_INTERLACE : 0) | (mode->doublescan? TRACE_MODE_DOUBLESCAN : 0);
+	record.weight = mode->result.weight;
+	record.hactive = mode->hactive;
+	record.vactive = mode->vactive;
+	record.x_scale = mode->result.x_scale;
+	record.y_scale = mode->result.y_scale;
+	record.v_scale = mode->result.v_scale;
+	record.vfreq = mode->vfreq;
+	record.hfreq = mode->hfreq;
+	trace_write(cs->trace, &record);
+}
+
+//============================================================
+//  switchres_set_mode_options
+//============================================================
+
+static void switchres_set_mode_options(config_settings *cs, modeline *mode)
+{
+	// apply options to mode type
+	if (!cs->modeline_generation)
+		mode->type &= ~XYV_EDITABLE;
+
+	if (cs->refresh_dont_care)
+		mode->type |= V_FREQ_EDITABLE;
+	
+	if (cs->lock_system_modes && (mode->type & CUSTOM_VIDEO_TIMING_SYSTEM) && !(mode->type & MODE_DESKTOP) && !(mode->type & MODE_USER_DEF))
+		mode->type |= MODE_DISABLED;
+
+	osd_printf_verbose("\nSwitchRes: %s%4d%sx%s%4d%s_%s%d=%.6fHz%s%s\n",
+		mode->type & X_RES_EDITABLE?"(":"[", mode->width, mode->type & X_RES_EDITABLE?")":"]",
+		mode->type & Y_RES_EDITABLE?"(":"[", mode->height, mode->type & Y_RES_EDITABLE?")":"]",
+		mode->type & V_FREQ_EDITABLE?"(":"[", mode->refresh, mode->vfreq, mode->type & V_FREQ_EDITABLE?")":"]",
+		mode->type & MODE_DISABLED?" - locked":"");
+}
+
+//============================================================
+//  switchres_try_mode
+//  Creates the mode for the given ranges and keeps it if it
+//  beats the best mode, or ties with it and comes first in
+//  table order. Ranges other than ALL_RANGES come from the
+//  mode index and are already prefiltered. Returns whether
+//  the best mode was replaced.
+//============================================================
+
+static bool switchres_try_mode(switchres_manager *switchres, modeline *s_mode, modeline *mode, int ranges, bool comes_first)
+{
+	config_settings *cs = &switchres->cs;
+	monitor_range *range = switchres->range;
+	modeline *best_mode = &switchres->best_mode;
+	modeline target_mode, *t_mode = &target_mode;
+	char result[256]={'\x00'};
+	bool replaced = false;
+
+	if (cs->trace)
+		cs->trace->mode = mode == &switchres->user_mode? 0 : mode - switchres->video_modes;
+
+	for (int j = 0 ; j < MAX_RANGES ; j++)
+	{
+		if (range[j].hfreq_min && (ranges & (1 << j)))
+		{
+			if (cs->search_stats) cs->search_stats->ranges++;
+
+			// skip ranges the mode can't possibly fit, out of range results
+			// never win over an in range one
+			bool rejected = false;
+			if (ranges == ALL_RANGES && !cs->disable_prefilter)
+			{
+				if (cs->prefilter_stats) cs->prefilter_stats->evaluated++;
+				rejected = modeline_prefilter(mode, &range[j], cs);
+			}
+
+			if (cs->trace)
+			{
+				cs->trace->range = j;
+				switchres_trace_mode(cs, TRACE_RANGE, rejected, mode);
+			}
+
+			if (rejected)
+			{
+				if (cs->prefilter_stats) cs->prefilter_stats->rejected++;
+				osd_printf_verbose("   rng(%d):  out of range (prefilter)\n", j);
+				continue;
+			}
+
+			memcpy(t_mode, mode, sizeof(struct modeline));
+			t_mode->range = j;
+			modeline_create(s_mode, t_mode, &range[j], cs);
+			SWITCHRES_PROBE3(range, (const char *)switchres->game.name, j, t_mode->result.weight);
+
+			osd_printf_verbose("%s\n", modeline_result(t_mode, result));
+
+			bool better = modeline_compare(t_mode, best_mode);
+			if (cs->search_stats) cs->search_stats->modeline_compares++;
+			if (!better && comes_first && !replaced)
+			{
+				better = !modeline_compare(best_mode, t_mode);
+				if (cs->search_stats) cs->search_stats->modeline_compares++;
+			}
+			if (cs->trace) switchres_trace_mode(cs, TRACE_COMPARE, better, t_mode);
+
+			if (better)
+			{
+				memcpy(best_mode, t_mode, sizeof(struct modeline));
+				replaced = true;
+			}
+		}
+	}
+
+	if (cs->trace) cs->trace->range = TRACE_NO_RANGE;
+	return replaced;
+}
+
+//============================================================
+//  switchres_index_video_modes
+//============================================================
+
+void switchres_index_video_modes(config_settings *cs, monitor_range *range, modeline *mode_table, video_mode_index *index)
+{
+	modeline mode;
+	int i, j;
+
+	index->count = index->fixed_count = index->editable_count = 0;
+
+	for (i = 1; i < MAX_MODELINES && mode_table[i].width; i++)
+	{
+		// the options are fixed for the table, apply them like the search will
+		memcpy(&mode, &mode_table[i], sizeof(struct modeline));
+		switchres_set_mode_options(cs, &mode);
+
+		index->count = i;
+		index->ranges[i] = 0;
+		if (mode.type & MODE_DISABLED)
+			continue;
+
+		for (j = 0 ; j < MAX_RANGES ; j++)
+			if (range[j].hfreq_min && !modeline_prefilter(&mode, &range[j], cs))
+				index->ranges[i] |= 1 << j;
+
+		if (!index->ranges[i])
+			continue;
+
+		if (mode.type & XYV_EDITABLE)
+			index->editable[index->editable_count++] = i;
+		else
+		{
+			// insertion sort by vfreq, vactive, interlace
+			for (j = index->fixed_count++; j > 0; j--)
+			{
+				modeline *prev = &mode_table[index->fixed[j - 1]];
+				if (prev->vfreq < mode.vfreq || (prev->vfreq == mode.vfreq && (prev->vactive < mode.vactive ||
+					(prev->vactive == mode.vactive && prev->interlace <= mode.interlace))))
+					break;
+				index->fixed[j] = index->fixed[j - 1];
+			}
+			index->fixed[j] = i;
+		}
+	}
+}
+
+//============================================================
+//  switchres_search_index
+//  Fixed modes off the source's refresh can't beat a result
+//  that is in range, unstretched and on refresh. So the modes
+//  that may be on refresh go first, and the rest only if they
+//  don't produce such a result. modeline_compare orders
+//  results lexicographically, so the table scan keeps the
+//  first of the best results in table order, and a tie with
+//  a mode that comes earlier is resolved the same way here.
+//============================================================
+
+static void switchres_search_index(switchres_manager *switchres, modeline *s_mode)
+{
+	config_settings *cs = &switchres->cs;
+	const video_mode_index *index = switchres->mode_index;
+	modeline *mode_table = switchres->video_modes;
+	modeline *best_mode = &switchres->best_mode;
+	bool candidate[MAX_MODELINES];
+	int i, k;
+
+	memset(candidate, 0, sizeof(candidate));
+	for (i = 1; i <= index->count; i++)
+		switchres_set_mode_options(cs, &mode_table[i]);
+
+	for (i = 0; i < index->editable_count; i++)
+		candidate[index->editable[i]] = true;
+
+	float tolerance = cs->sync_refresh_tolerance;
+	float vfreq_max = index->fixed_count? mode_table[index->fixed[index->fixed_count - 1]].vfreq : 0;
+
+	if (s_mode->vfreq - tolerance <= 0)
+	{
+		for (i = 0; i < index->fixed_count; i++)
+			candidate[index->fixed[i]] = true;
+	}
+
+	// a mode on refresh is within the tolerance of some multiple of the
+	// source's refresh, the windows are widened so rounding can't drop it
+	else for (k = 1; k * (s_mode->vfreq - tolerance) - k * 0.01 <= vfreq_max; k++)
+	{
+		double vfreq_lo = k * (s_mode->vfreq - tolerance) - k * 0.01;
+		double vfreq_hi = k * (s_mode->vfreq + tolerance) + k * 0.01;
+
+		int lo = 0, hi = index->fixed_count;
+		while (lo < hi)
+		{
+			int mid = (lo + hi) / 2;
+			if (mode_table[index->fixed[mid]].vfreq < vfreq_lo) lo = mid + 1;
+			else hi = mid;
+		}
+
+		for (i = lo; i < index->fixed_count && mode_table[index->fixed[i]].vfreq <= vfreq_hi; i++)
+			if (!modeline_refresh_off(s_mode, &mode_table[index->fixed[i]], cs))
+				candidate[index->fixed[i]] = true;
+	}
+
+	int best_position = 0;
+	for (i = 1; i <= index->count; i++)
+		if (candidate[i] && index->ranges[i] && switchres_try_mode(switchres, s_mode, &mode_table[i], index->ranges[i], false))
+			best_position = i;
+
+	if (best_mode->result.weight == 0)
+		return;
+
+	for (i = 1; i <= index->count; i++)
+		if (!candidate[i] && index->ranges[i] && switchres_try_mode(switchres, s_mode, &mode_table[i], index->ranges[i], i < best_position))
+			best_position = i;
+}
+
 //============================================================
 //  switchres_get_video_mode
 //============================================================
@@ -33,16 +274,14 @@ bool switchres_get_video_mode(running_machine &machine)
 	switchres_manager *switchres = &machine.switchres;
 	config_settings *cs = &switchres->cs;
 	game_info *game = &switchres->game;
-	monitor_range *range = switchres->range;
 	modeline *mode;
 	modeline *mode_table = switchres->video_modes;
 	modeline *best_mode = &switchres->best_mode;
 	modeline *user_mode = &switchres->user_mode;
 	modeline source_mode, *s_mode = &source_mode;
-	modeline target_mode, *t_mode = &target_mode;
 	char modeline[256]={'\x00'};
 	char result[256]={'\x00'};
-	int i = 0, j = 0, table_size = 0;
+	int i = 0, table_size = 0;
 
 	cs->effective_orientation = effective_orientation(machine);
 
@@ -56,6 +295,19 @@ bool switchres_get_video_mode(running_machine &machine)
 	s_mode->vactive = game->vector?1:game->height;
 	s_mode->vfreq = game->refresh;
 
+	if (cs->trace)
+	{
+		trace_record record;
+		memset(&record, 0, sizeof(trace_record));
+		record.type = TRACE_MACHINE;
+		record.hactive = s_mode->hactive;
+		record.vactive = s_mode->vactive;
+		record.vfreq = s_mode->vfreq;
+		cs->trace->range = TRACE_NO_RANGE;
+		cs->trace->mode = 0;
+		trace_write(cs->trace, &record);
+	}
+
 	if (user_mode->hactive)
 	{
 		table_size = 1;
@@ -68,46 +320,28 @@ bool switchres_get_video_mode(running_machine &machine)
 		mode = &mode_table[i];
 	}
 
-	while (mode->width && i < table_size)
+	if (!user_mode->hactive && switchres->mode_index)
+		switchres_search_index(switchres, s_mode);
+
+	else while (mode->width && i < table_size)
 	{
-		// apply options to mode type
-		if (!cs->modeline_generation)
-			mode->type &= ~XYV_EDITABLE;
-
-		if (cs->refresh_dont_care)
-			mode->type |= V_FREQ_EDITABLE;
-		
-		if (cs->lock_system_modes && (mode->type & CUSTOM_VIDEO_TIMING_SYSTEM) && !(mode->type & MODE_DESKTOP) && !(mode->type & MODE_USER_DEF))
-			mode->type |= MODE_DISABLED;
-
-		osd_printf_verbose("\nSwitchRes: %s%4d%sx%s%4d%s_%s%d=%.6fHz%s%s\n",
-			mode->type & X_RES_EDITABLE?"(":"[", mode->width, mode->type & X_RES_EDITABLE?")":"]",
-			mode->type & Y_RES_EDITABLE?"(":"[", mode->height, mode->type & Y_RES_EDITABLE?")":"]",
-			mode->type & V_FREQ_EDITABLE?"(":"[", mode->refresh, mode->vfreq, mode->type & V_FREQ_EDITABLE?")":"]",
-			mode->type & MODE_DISABLED?" - locked":"");
+		switchres_set_mode_options(cs, mode);
 
 		// now get the mode if allowed
 		if (!(mode->type & MODE_DISABLED))
-		{
-			for (j = 0 ; j < MAX_RANGES ; j++)
-			{
-				if (range[j].hfreq_min)
-				{
-					memcpy(t_mode, mode, sizeof(struct modeline));
-					modeline_create(s_mode, t_mode, &range[j], cs);
-					t_mode->range = j;
-
-					osd_printf_verbose("%s\n", modeline_result(t_mode, result));
+			switchres_try_mode(switchres, s_mode, mode, ALL_RANGES, false);
 
-					if (modeline_compare(t_mode, best_mode))
-						memcpy(best_mode, t_mode, sizeof(struct modeline));
-				}
-			}
-		}
 		mode++;
 		i++;
 	}
 
+	if (cs->trace)
+	{
+		cs->trace->mode = 0;
+		switchres_trace_mode(cs, TRACE_BEST, 0, best_mode);
+	}
+	SWITCHRES_PROBE3(best, (const char *)game->name, best_mode->range, best_mode->result.weight);
+
 	if (best_mode->result.weight & R_OUT_OF_RANGE)
 	{
 		osd_printf_error("SwitchRes: could not find a video mode that meets your specs\n");
@@ -296,20 +530,17 @@ bool switchres_check_resolution_change(running_machine &machine)
 	float new_vfreq = game->refresh;
 	bool new_orientation = effective_orientation(machine);
 
-  /*
-	screen_device_iterator scriter(machine.root_device());
-	if (scriter.count())
+	// there's only the one screen, its state is set by the caller
+	screen_device *screen = &machine.root_device();
+	if (screen->screen_type() != SCREEN_TYPE_VECTOR)
 	{
-		screen_device *screen = scriter.first();
-		if (screen->frame_number())
-		{
-			const rectangle &visarea = screen->visible_area();
-			new_width = new_orientation? visarea.height() : visarea.width();
-			new_height = new_orientation? visarea.width() : visarea.height();
-			new_vfreq = ATTOSECONDS_TO_HZ(screen->frame_period().m_attoseconds);
-		}
+		const rectangle &visarea = screen->visible_area();
+		int w = visarea.max_x - visarea.min_x + 1;
+		int h = visarea.max_y - visarea.min_y + 1;
+		new_width = new_orientation? h : w;
+		new_height = new_orientation? w : h;
 	}
-  */
+	new_vfreq = ATTOSECONDS_TO_HZ(screen->refresh_attoseconds());
 
 	if (game->width != new_width || game->height != new_height || new_vfreq != game->refresh || cs->effective_orientation != new_orientation)
 	{
@@ -62,10 +62,31 @@ typedef struct config_settings
 	bool   lock_system_modes;
 	bool   refresh_dont_care;
 	float  sync_refresh_tolerance;
+	bool   disable_prefilter;
+	struct line_params_cache *line_cache;
+	struct prefilter_stats *prefilter_stats;
+	struct search_stats *search_stats;
+	struct trace_buffer *trace;
 } config_settings;
 
 #include "monitor.h"
 #include "modeline.h"
+#include "trace.h"
+
+// Index of a video mode table for a set of ranges and options. A mode with
+// nothing editable fits a range or not just by its own vactive, vfreq and
+// interlace, so that is resolved once per table instead of once per search,
+// and those modes are sorted by vfreq to quickly find the ones on the
+// source's refresh. Positions start at 1 like the table scan.
+typedef struct video_mode_index
+{
+	int    count;                     // table entries
+	int    ranges[MAX_MODELINES];     // per position, bitmask of the ranges the mode can fit
+	int    fixed[MAX_MODELINES];      // positions of fixed modes, by vfreq, vactive, interlace
+	int    fixed_count;
+	int    editable[MAX_MODELINES];   // positions of modes with anything editable, in table order
+	int    editable_count;
+} video_mode_index;
 
 typedef struct switchres_manager
 {
@@ -75,6 +96,7 @@ typedef struct switchres_manager
 	struct modeline user_mode;
 	struct monitor_range range[MAX_RANGES];
 	struct modeline video_modes[MAX_MODELINES];
+	const struct video_mode_index *mode_index;
 } switchres_manager;
 
 #endif
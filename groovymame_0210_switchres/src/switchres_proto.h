@@ -27,6 +27,7 @@ int real_res(int x);
 
 // switchres.cpp
 bool switchres_get_video_mode(running_machine &machine);
+void switchres_index_video_modes(config_settings *cs, monitor_range *range, modeline *mode_table, video_mode_index *index);
 int switchres_get_monitor_specs(running_machine &machine);
 void switchres_init(running_machine &machine);
 void switchres_get_game_info(running_machine &machine);
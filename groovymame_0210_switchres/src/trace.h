@@ -0,0 +1,80 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+
+// Structured trace of the mode search, to see why a machine got its mode
+// without enabling osd_printf_verbose. Each thread writes fixed size
+// records into its own ring buffer (the oldest records are overwritten
+// once it is full) and only for the machines being traced: the engine
+// hooks check config_settings' trace pointer, which is NULL otherwise.
+// The buffers are written to a file at the end of the batch and decoded
+// offline with the native trace-decode command.
+//
+// A machine's search is, in order:
+//   TRACE_MACHINE  the source mode (hactive, vactive, vfreq)
+//   per range tried for a mode of the table (mode is its index, 0 for the
+//   user or generated mode):
+//     TRACE_RANGE    detail is 1 if the prefilter rejected it
+//     TRACE_CREATE   the modeline_create result: scales, interlace and
+//                    doublescan, the weight flags, detail is the TRACE_EXIT_*
+//                    it returned at and doublings the times the pixel clock
+//                    was below the minimum and hactive was doubled
+//     TRACE_COMPARE  detail is 1 if the mode became the best one
+//   TRACE_BEST     the best mode
+
+#define TRACE_MACHINE 1
+#define TRACE_RANGE   2
+#define TRACE_CREATE  3
+#define TRACE_COMPARE 4
+#define TRACE_BEST    5
+
+// where modeline_create returned
+#define TRACE_EXIT_DONE        0
+#define TRACE_EXIT_VFREQ       1 // fixed refresh outside of the range
+#define TRACE_EXIT_VFREQ_YRES  2 // fixed refresh unreachable with the lines
+#define TRACE_EXIT_YRES        3 // lines don't fit and can't be stretched
+#define TRACE_EXIT_PCLOCK      4 // pixel clock below the minimum, fixed width
+
+#define TRACE_MODE_INTERLACE  0x01
+#define TRACE_MODE_DOUBLESCAN 0x02
+
+#define TRACE_NO_RANGE 0xff
+
+typedef struct trace_record {
+  uint8_t  type;
+  uint8_t  range;
+  uint8_t  detail;
+  uint8_t  mode_flags;
+  uint32_t machine;   // index into the buffer's machine names
+  int32_t  weight;
+  uint16_t mode;
+  int16_t  hactive;
+  int16_t  vactive;
+  int16_t  x_scale;
+  int16_t  y_scale;
+  int16_t  v_scale;
+  int16_t  doublings;
+  int16_t  reserved;
+  float    vfreq;
+  float    hfreq;
+} trace_record;
+
+typedef struct trace_buffer {
+  trace_record *records;
+  uint32_t      mask;    // capacity - 1, the capacity is a power of 2
+  uint64_t      written;
+  // stamped on every record
+  uint32_t      machine;
+  uint8_t       range;   // TRACE_NO_RANGE outside of a range
+  uint16_t      mode;
+} trace_buffer;
+
+static inline void trace_write(trace_buffer *trace, trace_record *record) {
+  record->machine = trace->machine;
+  record->range = trace->range;
+  record->mode = trace->mode;
+  trace->records[trace->written++ & trace->mask] = *record;
+}
+
+#endif // __TRACE_H__
@@ -0,0 +1,233 @@
+#include "trace_file.h"
+#include <algorithm>
+#include <memory>
+
+static const char *const type_names[] = {
+  "", "machine", "range", "create", "compare", "best"
+};
+
+static const char *const exit_names[] = {
+  "done", "vfreq", "vfreqYres", "yres", "pclock"
+};
+
+void parse_trace_options(json &trace_json, t_trace_options *options) {
+  options->enabled = false;
+  options->path.clear();
+  options->machines.clear();
+  options->records = TRACE_DEFAULT_RECORDS;
+
+  if (trace_json.is_null()) {
+    return;
+  }
+  if (!trace_json.is_object() || !trace_json["path"].is_string()) {
+    throw std::invalid_argument("Trace needs a \"path\".");
+  }
+
+  options->enabled = true;
+  options->path = trace_json["path"].get<std::string>();
+
+  json machines_json = trace_json["machines"];
+  if (!machines_json.is_null()) {
+    for (json &name : machines_json) {
+      options->machines.insert(name.get<std::string>());
+    }
+  }
+
+  json records_json = trace_json["records"];
+  if (!records_json.is_null()) {
+    int records = records_json.get<int>();
+    if (records < 1 || records > (1 << 24)) {
+      throw std::invalid_argument("Trace records must be between 1 and 16777216.");
+    }
+    options->records = 1;
+    while (options->records < uint32_t(records)) {
+      options->records <<= 1;
+    }
+  }
+}
+
+void trace_thread_init(t_trace_thread *thread, const t_trace_options *options) {
+  thread->options = options;
+  thread->records.assign(options->records, trace_record());
+  thread->machines.clear();
+  memset(&thread->buffer, 0, sizeof(trace_buffer));
+  thread->buffer.records = thread->records.data();
+  thread->buffer.mask = options->records - 1;
+  thread->buffer.range = TRACE_NO_RANGE;
+}
+
+trace_buffer *trace_machine(t_trace_thread *thread, const char *machine_name) {
+  const std::set<std::string> &machines = thread->options->machines;
+  if (!machines.empty() && !machines.count(machine_name)) {
+    return NULL;
+  }
+
+  thread->buffer.machine = thread->machines.size();
+  thread->machines.push_back(machine_name);
+  return &thread->buffer;
+}
+
+static void write_bytes(FILE *file, const void *data, size_t size) {
+  if (size && fwrite(data, 1, size, file) != size) {
+    throw std::runtime_error("Unable to write the trace file.");
+  }
+}
+
+static void write_u32(FILE *file, uint32_t value) {
+  write_bytes(file, &value, sizeof(value));
+}
+
+void write_trace_file(const char *path, const std::vector<const t_trace_thread*> &threads) {
+  std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(path, "wb"), fclose);
+  if (!file) {
+    throw std::runtime_error(std::string("Unable to open the trace file: ") + path);
+  }
+
+  write_bytes(file.get(), TRACE_FILE_MAGIC, 8);
+  write_u32(file.get(), TRACE_FILE_VERSION);
+  write_u32(file.get(), sizeof(trace_record));
+  write_u32(file.get(), threads.size());
+
+  for (const t_trace_thread *thread : threads) {
+    write_u32(file.get(), thread->machines.size());
+    for (const std::string &name : thread->machines) {
+      write_u32(file.get(), name.size());
+      write_bytes(file.get(), name.data(), name.size());
+    }
+
+    const trace_buffer *buffer = &thread->buffer;
+    uint64_t capacity = uint64_t(buffer->mask) + 1;
+    uint64_t kept = std::min(buffer->written, capacity);
+    write_bytes(file.get(), &buffer->written, sizeof(buffer->written));
+    write_u32(file.get(), kept);
+
+    // oldest first: once full the oldest is where the next one goes
+    uint64_t first = buffer->written - kept;
+    for (uint64_t i = first; i < buffer->written; ++i) {
+      write_bytes(file.get(), &buffer->records[i & buffer->mask], sizeof(trace_record));
+    }
+  }
+}
+
+static void read_bytes(FILE *file, void *data, size_t size) {
+  if (size && fread(data, 1, size, file) != size) {
+    throw std::runtime_error("Truncated trace file.");
+  }
+}
+
+static uint32_t read_u32(FILE *file) {
+  uint32_t value;
+  read_bytes(file, &value, sizeof(value));
+  return value;
+}
+
+static json decode_trace_record(const trace_record *record) {
+  const char *type = record->type < sizeof(type_names) / sizeof(type_names[0])? type_names[record->type] : "";
+  json record_json = {
+    {"type", type}
+  };
+
+  switch (record->type) {
+    case TRACE_MACHINE:
+      record_json["hactive"] = record->hactive;
+      record_json["vactive"] = record->vactive;
+      record_json["vfreq"]   = record->vfreq;
+      return record_json;
+
+    case TRACE_RANGE:
+      record_json["range"]       = record->range;
+      record_json["mode"]        = record->mode;
+      record_json["prefiltered"] = record->detail? true : false;
+      return record_json;
+
+    case TRACE_CREATE:
+      record_json["range"] = record->range;
+      record_json["mode"]  = record->mode;
+      record_json["exit"]  = record->detail < sizeof(exit_names) / sizeof(exit_names[0])? exit_names[record->detail] : "";
+      record_json["doublings"] = record->doublings;
+      break;
+
+    case TRACE_COMPARE:
+      record_json["range"] = record->range;
+      record_json["mode"]  = record->mode;
+      record_json["best"]  = record->detail? true : false;
+      break;
+
+    case TRACE_BEST:
+      break;
+
+    default:
+      return record_json;
+  }
+
+  record_json["hactive"]    = record->hactive;
+  record_json["vactive"]    = record->vactive;
+  record_json["vfreq"]      = record->vfreq;
+  record_json["hfreq"]      = record->hfreq;
+  record_json["interlace"]  = record->mode_flags & TRACE_MODE_INTERLACE ? true : false;
+  record_json["doublescan"] = record->mode_flags & TRACE_MODE_DOUBLESCAN? true : false;
+  record_json["xScale"]     = record->x_scale;
+  record_json["yScale"]     = record->y_scale;
+  record_json["vScale"]     = record->v_scale;
+  record_json["outOfRange"] = record->weight & R_OUT_OF_RANGE? true : false;
+  record_json["vfreqOff"]   = record->weight & R_V_FREQ_OFF  ? true : false;
+  record_json["resStretch"] = record->weight & R_RES_STRETCH ? true : false;
+  record_json["weight"]     = record->weight;
+  return record_json;
+}
+
+json decode_trace_file(const char *path) {
+  std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(path, "rb"), fclose);
+  if (!file) {
+    throw std::runtime_error(std::string("Unable to open the trace file: ") + path);
+  }
+
+  char magic[8];
+  read_bytes(file.get(), magic, sizeof(magic));
+  if (memcmp(magic, TRACE_FILE_MAGIC, sizeof(magic))) {
+    throw std::runtime_error("Not a trace file.");
+  }
+  if (read_u32(file.get()) != TRACE_FILE_VERSION || read_u32(file.get()) != sizeof(trace_record)) {
+    throw std::runtime_error("Unsupported trace file version.");
+  }
+
+  uint32_t threads = read_u32(file.get());
+  uint64_t written = 0;
+  uint64_t kept = 0;
+  json machines_json = json::object();
+
+  for (uint32_t i = 0; i < threads; ++i) {
+    std::vector<std::string> machines(read_u32(file.get()));
+    for (std::string &name : machines) {
+      name.resize(read_u32(file.get()));
+      read_bytes(file.get(), &name[0], name.size());
+    }
+
+    uint64_t thread_written;
+    read_bytes(file.get(), &thread_written, sizeof(thread_written));
+    uint32_t thread_kept = read_u32(file.get());
+    written += thread_written;
+    kept += thread_kept;
+
+    for (uint32_t j = 0; j < thread_kept; ++j) {
+      trace_record record;
+      read_bytes(file.get(), &record, sizeof(trace_record));
+      if (record.machine >= machines.size()) {
+        throw std::runtime_error("Corrupt trace file.");
+      }
+
+      json &records_json = machines_json[machines[record.machine]];
+      if (records_json.is_null()) {
+        records_json = json::array();
+      }
+      records_json.push_back(decode_trace_record(&record));
+    }
+  }
+
+  return {
+    {"threads",  threads         },
+    {"records",  kept            },
+    {"dropped",  written - kept  },
+    {"machines", machines_json   }
+  };
+}
@@ -0,0 +1,51 @@
+#ifndef __TRACE_FILE_H__
+#define __TRACE_FILE_H__
+
+#include "ext.h"
+#include "../lib/json.hpp"
+#include <set>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+#define TRACE_FILE_MAGIC    "SRTRACE1"
+#define TRACE_FILE_VERSION  1
+#define TRACE_DEFAULT_RECORDS (1 << 16)
+
+// the "trace" input option:
+//   "path"     the file the trace is written to
+//   "machines" the names of the machines to trace, every machine if omitted
+//   "records"  the ring buffer capacity per thread (rounded up to a power
+//              of 2), the oldest records are lost past it
+typedef struct t_trace_options {
+  bool                  enabled;
+  std::string           path;
+  std::set<std::string> machines;
+  uint32_t              records;
+} t_trace_options;
+
+// a thread's ring buffer and the names of the machines it traced
+typedef struct t_trace_thread {
+  const t_trace_options    *options;
+  trace_buffer              buffer;
+  std::vector<trace_record> records;
+  std::vector<std::string>  machines;
+} t_trace_thread;
+
+void parse_trace_options(json &trace_json, t_trace_options *options);
+void trace_thread_init(t_trace_thread *thread, const t_trace_options *options);
+
+// the buffer to trace the machine's search with, NULL if it isn't traced
+trace_buffer *trace_machine(t_trace_thread *thread, const char *machine_name);
+
+// The file is the header (magic, version, record size and thread count as
+// u32) then per thread the machine names (u32 count, then u32 length and
+// the characters of each), the u64 records written, the u32 records kept
+// and the kept records, oldest first. Everything is in host byte order.
+void write_trace_file(const char *path, const std::vector<const t_trace_thread*> &threads);
+
+// every traced machine's records in search order, by machine name
+json decode_trace_file(const char *path);
+
+#endif // __TRACE_FILE_H__
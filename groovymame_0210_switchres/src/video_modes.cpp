@@ -0,0 +1,286 @@
+#include "video_modes.h"
+#include <climits>
+#include <fstream>
+#include <sstream>
+
+static void video_mode_err(int line_number, const std::string &line, const char *reason) {
+  throw std::invalid_argument("Invalid video mode on line " + std::to_string(line_number) + " (" + reason + "): " + line);
+}
+
+// applies a trailing keyword, returns false if it isn't one
+static bool apply_video_mode_keyword(const std::string &token, int *type) {
+  if      (token == "system" ) *type = (*type & ~CUSTOM_VIDEO_TIMING_MASK) | CUSTOM_VIDEO_TIMING_SYSTEM;
+  else if (token == "custom" ) *type = (*type & ~CUSTOM_VIDEO_TIMING_MASK) | CUSTOM_VIDEO_TIMING_XRANDR;
+  else if (token == "desktop") *type |= MODE_DESKTOP;
+  else if (token == "xres"   ) *type |= X_RES_EDITABLE;
+  else if (token == "yres"   ) *type |= Y_RES_EDITABLE;
+  else if (token == "vfreq"  ) *type |= V_FREQ_EDITABLE;
+  else return false;
+  return true;
+}
+
+static bool is_timing_flag(const std::string &token) {
+  return (
+    token == "interlace" || token == "doublescan" ||
+    token == "+hsync"    || token == "-hsync"     ||
+    token == "+vsync"    || token == "-vsync"
+  );
+}
+
+static void add_video_mode(modeline *mode_table, int *count, const modeline *mode, int line_number, const std::string &line) {
+  if (*count + 1 >= MAX_MODELINES) {
+    video_mode_err(line_number, line, "too many video modes");
+  }
+  mode_table[++*count] = *mode;
+}
+
+int parse_video_modes(const std::string &text, modeline *mode_table, int count) {
+  std::istringstream lines(text);
+  std::string line;
+  int line_number = 0;
+
+  while (std::getline(lines, line)) {
+    ++line_number;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+
+    std::istringstream tokens_stream(line);
+    std::vector<std::string> tokens;
+    std::string token;
+    while (tokens_stream >> token) tokens.push_back(token);
+    if (tokens.empty() || tokens[0][0] == '#') continue;
+
+    modeline mode;
+    memset(&mode, 0, sizeof(mode));
+
+    if (tokens[0] == "modeline" || tokens[0] == "Modeline") {
+      // the modeline parser takes the line from the (quoted) name on and
+      // picks the timing flags out of it
+      std::string timings = line.substr(line.find(tokens[0]) + tokens[0].size());
+      if (!parse_modeline_fast(timings.c_str(), &mode, NULL)) {
+        video_mode_err(line_number, line, "bad timings");
+      }
+      mode.width  = mode.hactive;
+      mode.height = mode.vactive;
+      mode.type   = CUSTOM_VIDEO_TIMING_XRANDR;
+
+      size_t quote = timings.find('"');
+      std::istringstream rest(quote == std::string::npos? timings : timings.substr(timings.find('"', quote + 1) + 1));
+      for (int i = 0; rest >> token; ++i) {
+        // past the 9 timing values
+        if (i >= 9 && !is_timing_flag(token) && !apply_video_mode_keyword(token, &mode.type)) {
+          video_mode_err(line_number, line, "unknown keyword");
+        }
+      }
+
+      add_video_mode(mode_table, &count, &mode, line_number, line);
+      continue;
+    }
+
+    // <width>x<height>[i][@<refresh>]
+    int width = 0, height = 0, consumed = 0;
+    if (sscanf(tokens[0].c_str(), "%dx%d%n", &width, &height, &consumed) != 2 || width < 1 || height < 1) {
+      video_mode_err(line_number, line, "expected a resolution");
+    }
+    const char *rest = tokens[0].c_str() + consumed;
+    bool interlace = false;
+    if (*rest == 'i') {
+      interlace = true;
+      ++rest;
+    }
+    else if (*rest == 'p') {
+      ++rest;
+    }
+
+    std::vector<std::pair<double, bool>> refreshes;
+    int type = CUSTOM_VIDEO_TIMING_SYSTEM;
+
+    if (*rest == '@') {
+      char *end;
+      double refresh = strtod(rest + 1, &end);
+      if (end == rest + 1 || *end) {
+        video_mode_err(line_number, line, "bad refresh");
+      }
+      refreshes.push_back(std::make_pair(refresh, false));
+    }
+    else if (*rest) {
+      video_mode_err(line_number, line, "expected a resolution");
+    }
+
+    for (size_t i = 1; i < tokens.size(); ++i) {
+      if (apply_video_mode_keyword(tokens[i], &type)) continue;
+
+      // xrandr marks the current mode with '*' and the preferred one with '+'
+      char *end;
+      double refresh = strtod(tokens[i].c_str(), &end);
+      if (end == tokens[i].c_str()) {
+        video_mode_err(line_number, line, "unknown keyword");
+      }
+      bool desktop = false;
+      for (; *end; ++end) {
+        if (*end == '*') desktop = true;
+        else if (*end != '+') video_mode_err(line_number, line, "bad refresh");
+      }
+      refreshes.push_back(std::make_pair(refresh, desktop));
+    }
+
+    if (refreshes.empty()) {
+      video_mode_err(line_number, line, "missing refresh");
+    }
+
+    for (std::pair<double, bool> &refresh : refreshes) {
+      if (!(refresh.first > 0)) {
+        video_mode_err(line_number, line, "bad refresh");
+      }
+      mode.width     = mode.hactive = width;
+      mode.height    = mode.vactive = height;
+      mode.interlace = interlace;
+      mode.vfreq     = refresh.first;
+      mode.refresh   = mode.vfreq;
+      mode.type      = type | (refresh.second? MODE_DESKTOP : 0);
+      add_video_mode(mode_table, &count, &mode, line_number, line);
+    }
+  }
+
+  return count;
+}
+
+std::string read_video_modes_file(const char *path) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file) {
+    throw std::invalid_argument(std::string("Unable to read video modes file: ") + path);
+  }
+
+  std::ostringstream text;
+  text << file.rdbuf();
+  return text.str();
+}
+
+static const char *skip_spaces(const char *p) {
+  while (isspace((unsigned char)*p)) ++p;
+  return p;
+}
+
+static bool parse_int_fast(const char **p, int *value) {
+  const char *s = skip_spaces(*p);
+  bool negative = *s == '-';
+  if (*s == '-' || *s == '+') ++s;
+  if (!isdigit((unsigned char)*s)) return false;
+
+  long long n = 0;
+  for (; isdigit((unsigned char)*s); ++s) {
+    n = n * 10 + (*s - '0');
+    if (n > INT_MAX) return false;
+  }
+  *value = negative? -int(n) : int(n);
+  *p = s;
+  return true;
+}
+
+// Plain decimals with up to 7 significant digits and 10 fraction digits
+// are exact as a float division (both operands are exact floats), which is
+// the correctly rounded value strtof/sscanf return. Anything else goes
+// through strtof.
+static bool parse_float_fast(const char **p, float *value) {
+  static const float pow10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+  const char *start = skip_spaces(*p);
+  const char *s = start;
+  bool negative = *s == '-';
+  if (*s == '-' || *s == '+') ++s;
+
+  u32 mantissa = 0;
+  int digits = 0, fraction = 0;
+  bool exact = true;
+  for (; isdigit((unsigned char)*s); ++s, ++digits) {
+    mantissa = mantissa * 10 + (*s - '0');
+    if (mantissa >= (1 << 24)) exact = false;
+  }
+  if (*s == '.') {
+    for (++s; isdigit((unsigned char)*s); ++s, ++digits, ++fraction) {
+      mantissa = mantissa * 10 + (*s - '0');
+      if (mantissa >= (1 << 24) || fraction >= 10) exact = false;
+    }
+  }
+
+  if (exact && digits && !isalpha((unsigned char)*s)) {
+    float n = float(mantissa) / pow10[fraction];
+    *value = negative? -n : n;
+    *p = s;
+    return true;
+  }
+
+  char *end;
+  *value = strtof(start, &end);
+  if (end == start) return false;
+  *p = end;
+  return true;
+}
+
+bool parse_modeline_fast(const char *str, modeline *mode, std::string *name) {
+  // like modeline_parse, the name is whatever is quoted
+  const char *quote_start = strchr(str, '"');
+  if (quote_start) {
+    const char *quote_end = strchr(quote_start + 1, '"');
+    if (!quote_end) return false;
+    if (name) name->assign(quote_start + 1, quote_end);
+    str = quote_end + 1;
+  }
+
+  float pclock;
+  const char *p = str;
+  if (
+    !parse_float_fast(&p, &pclock)         ||
+    !parse_int_fast(&p, &mode->hactive)    ||
+    !parse_int_fast(&p, &mode->hbegin)     ||
+    !parse_int_fast(&p, &mode->hend)       ||
+    !parse_int_fast(&p, &mode->htotal)     ||
+    !parse_int_fast(&p, &mode->vactive)    ||
+    !parse_int_fast(&p, &mode->vbegin)     ||
+    !parse_int_fast(&p, &mode->vend)       ||
+    !parse_int_fast(&p, &mode->vtotal)     ||
+    mode->htotal <= 0 || mode->vtotal <= 0
+  ) {
+    memset(mode, 0, sizeof(modeline));
+    return false;
+  }
+
+  mode->interlace  = strstr(str, "interlace") ?1:0;
+  mode->doublescan = strstr(str, "doublescan")?1:0;
+  mode->hsync      = strstr(str, "+hsync")    ?1:0;
+  mode->vsync      = strstr(str, "+vsync")    ?1:0;
+
+  // same as modeline_parse
+  mode->pclock = pclock * 1000000.0;
+  mode->hfreq = mode->pclock / mode->htotal;
+  mode->vfreq = mode->hfreq / mode->vtotal * (mode->interlace?2:1);
+  mode->refresh = mode->vfreq;
+  return true;
+}
+
+void parse_modeline_list(const std::string &text, std::vector<t_user_modeline> &modelines) {
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find('\n', pos);
+    if (end == std::string::npos) end = text.size();
+
+    const char *line = skip_spaces(text.c_str() + pos);
+    const char *line_end = text.c_str() + end;
+    pos = end + 1;
+    while (line_end > line && isspace((unsigned char)line_end[-1])) --line_end;
+    if (line == line_end || *line == '#') continue;
+
+    // the keyword isn't part of what modeline_parse takes
+    if (line_end - line > 8 && !strncasecmp(line, "modeline", 8) && isspace((unsigned char)line[8])) {
+      line = skip_spaces(line + 8);
+    }
+
+    t_user_modeline user_modeline;
+    user_modeline.text.assign(line, line_end);
+    memset(&user_modeline.mode, 0, sizeof(modeline));
+
+    if (!parse_modeline_fast(user_modeline.text.c_str(), &user_modeline.mode, &user_modeline.name)) {
+      user_modeline.err = "Invalid modeline.";
+    }
+    modelines.push_back(user_modeline);
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef __VIDEO_MODES_H__
+#define __VIDEO_MODES_H__
+
+#include "ext.h"
+#include <string>
+#include <vector>
+
+// A list of the video modes a fixed mode setup offers, one mode per line.
+// Blank lines and lines starting with '#' are ignored. A line is either
+//
+//   modeline "<name>" <pclock> <hdisp> <hsyncstart> <hsyncend> <htotal> <vdisp> <vsyncstart> <vsyncend> <vtotal> [flags]
+//     full timings as printed by xrandr/SwitchRes, a custom mode
+//   <width>x<height>[i][@<refresh>] [<refresh>[*][+] ...]
+//     a system mode per refresh, as in a CRT_EmuDriver mode list or the
+//     mode lines of `xrandr` ('*' marks the desktop mode)
+//
+// followed by any of the keywords "system", "custom" and "desktop", and
+// "xres", "yres" and "vfreq" to make that part of the mode editable. System
+// modes are locked unless lockSystemModes is off, like in GroovyMAME.
+//
+// Modes are appended to the count modes already stored from position 1 of
+// mode_table (like switchres_manager's video_modes), the new count is
+// returned.
+int parse_video_modes(const std::string &text, modeline *mode_table, int count);
+std::string read_video_modes_file(const char *path);
+
+// Same as modeline_parse (a quoted name, then pclock in MHz and the 8
+// horizontal/vertical values, then the timing flags) without sscanf, for
+// lists of many modelines. Also rejects a zero htotal or vtotal. The name
+// is stored if name isn't NULL.
+bool parse_modeline_fast(const char *str, modeline *mode, std::string *name);
+
+// a line of a modeline list, see parse_modeline_list
+typedef struct t_user_modeline {
+  std::string name;
+  std::string text;
+  modeline    mode;
+  std::string err;
+} t_user_modeline;
+
+// Parses a list with a modeline per line (optionally starting with the
+// "Modeline" keyword, blank lines and lines starting with '#' are
+// ignored). A line that doesn't parse gets an error instead of failing the
+// whole list.
+void parse_modeline_list(const std::string &text, std::vector<t_user_modeline> &modelines);
+
+#endif // __VIDEO_MODES_H__
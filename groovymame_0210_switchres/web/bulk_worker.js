@@ -0,0 +1,58 @@
+/*
+ * Runs the pthreads build (make wasm-threads) in a dedicated worker.
+ * calc_modelines_bulk waits for its pthreads to finish, which the
+ * browser's main thread can't do without freezing the page (it can't
+ * Atomics.wait), so the UI sends its calls here instead, see
+ * src/modelineCalculator.ts. Messages:
+ *   {moduleUri, wasmUri, workerUri}  first, loads the module and answers
+ *                                    {ready: true} or {err}
+ *   {id, method, input}              ccalls method with the input JSON and
+ *                                    answers {id, output} or {id, err}
+ * Copied next to the module as groovymame_0210_switchres.bulk.js.
+ */
+
+'use strict';
+
+/* global initModule */
+
+let switchResModule = null;
+
+function loadModule({moduleUri, wasmUri, workerUri}) {
+  importScripts(moduleUri);
+
+  const module = initModule({
+    // the pthreads load the module's script from here
+    mainScriptUrlOrBlob: moduleUri,
+    locateFile(path) {
+      if (path.endsWith('.wasm')) return wasmUri;
+      if (path.endsWith('.worker.js')) return workerUri;
+      return path;
+    }
+  });
+
+  module.then(() => {
+    switchResModule = module;
+    self.postMessage({ready: true});
+  });
+}
+
+self.onmessage = event => {
+  const message = event.data;
+
+  if (message.moduleUri) {
+    try {
+      loadModule(message);
+    } catch(err) {
+      self.postMessage({err: err.message});
+    }
+    return;
+  }
+
+  try {
+    if (!switchResModule) throw new Error(`Not initialized.`);
+    const output = switchResModule.ccall(message.method, 'string', ['string'], [message.input]);
+    self.postMessage({id: message.id, output});
+  } catch(err) {
+    self.postMessage({id: message.id, err: err.message});
+  }
+};
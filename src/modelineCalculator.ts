@@ -1,7 +1,7 @@
-import {TJSONValue} from './types/json';
+import {TJSONValue, IJSONObject} from './types/json';
 import {
   TInitModule,
-  ISwitchResEMCModule,
+  TSwitchResMethodName,
   ISwitchResInput,
   ISwitchResMachineInput,
   ISwitchResDisplay,
@@ -22,7 +22,8 @@ import {
   IGameDisplay
 } from './types/game';
 import {
-  deserializeMap
+  deserializeMap,
+  deserializeArray
 } from './types/jsonSerializer';
 import {
   serializeSwitchResInput,
@@ -39,29 +40,182 @@ function createCalcCacheKey(
 }
 
 
-let switchResEMCModule: ISwitchResEMCModule | null = null;
+// calls an exported function of the module with the JSON input string
+type TSwitchResCall = (methodName: TSwitchResMethodName, inputStr: string) => Promise<string>;
+let switchResCall: TSwitchResCall | null = null;
 
-async function _init(): Promise<void> {
-  const initModule: TInitModule = (await import(
-    /* webpackChunkName: "switchres" */
-    'switchres/groovymame_0210_switchres.js'
-  )).default;
-  const wasmUri = (await import(
-    /* webpackChunkName: "switchres" */
-    'switchres/groovymame_0210_switchres.wasm'
-  )).default;
-  
-  const _switchResEMCModule = initModule({
+// The smallest module using a SIMD instruction (v128 i8x16.splat/popcnt).
+// It only validates where the browser supports wasm SIMD.
+const wasmSIMDTestModule = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11
+]);
+
+function supportsWasmSIMD(): boolean {
+  try {
+    return typeof WebAssembly === 'object' && WebAssembly.validate(wasmSIMDTestModule);
+  } catch(err) {
+    return false;
+  }
+}
+
+// The pthreads build (`make wasm-threads`) needs SharedArrayBuffer, which
+// browsers only provide to cross-origin isolated pages.
+function supportsWasmThreads(): boolean {
+  return (
+    typeof SharedArrayBuffer === 'function' &&
+    (window as {crossOriginIsolated?: boolean}).crossOriginIsolated === true
+  );
+}
+
+interface ISwitchResModuleImport {
+  threads   : false;
+  initModule: TInitModule;
+  wasmUri   : string;
+}
+
+// the pthreads build is only referenced by URL, it is loaded by its bulk
+// worker
+interface ISwitchResThreadsImport {
+  threads      : true;
+  bulkWorkerUri: string;
+  moduleUri    : string;
+  wasmUri      : string;
+  workerUri    : string;
+}
+
+type TSwitchResImport = ISwitchResModuleImport | ISwitchResThreadsImport;
+
+// The SIMD (`make wasm-simd`), plain (`make wasm`) and pthreads builds all
+// export the same functions with the same results. The pthreads build is
+// used for bulk calls where it can run, otherwise the SIMD one where the
+// browser supports it.
+async function importSwitchRes(): Promise<TSwitchResImport> {
+  if (supportsWasmThreads()) {
+    return {
+      threads: true,
+      bulkWorkerUri: (await import(
+        /* webpackChunkName: "switchres-threads" */
+        'switchres-threads/groovymame_0210_switchres.bulk.js'
+      )).default,
+      moduleUri: (await import(
+        /* webpackChunkName: "switchres-threads" */
+        'switchres-threads/groovymame_0210_switchres.js'
+      )).default,
+      wasmUri: (await import(
+        /* webpackChunkName: "switchres-threads" */
+        'switchres-threads/groovymame_0210_switchres.wasm'
+      )).default,
+      workerUri: (await import(
+        /* webpackChunkName: "switchres-threads" */
+        'switchres-threads/groovymame_0210_switchres.worker.js'
+      )).default
+    };
+  }
+  
+  if (supportsWasmSIMD()) {
+    return {
+      threads: false,
+      initModule: (await import(
+        /* webpackChunkName: "switchres-simd" */
+        'switchres-simd/groovymame_0210_switchres.js'
+      )).default,
+      wasmUri: (await import(
+        /* webpackChunkName: "switchres-simd" */
+        'switchres-simd/groovymame_0210_switchres.wasm'
+      )).default
+    };
+  }
+  
+  return {
+    threads: false,
+    initModule: (await import(
+      /* webpackChunkName: "switchres" */
+      'switchres/groovymame_0210_switchres.js'
+    )).default,
+    wasmUri: (await import(
+      /* webpackChunkName: "switchres" */
+      'switchres/groovymame_0210_switchres.wasm'
+    )).default
+  };
+}
+
+// the single-threaded builds run on the page's thread
+async function initSwitchResModule({initModule, wasmUri}: ISwitchResModuleImport): Promise<TSwitchResCall> {
+  const switchResEMCModule = initModule({
     locateFile(path: string): string {
-      return path.endsWith('.wasm')? wasmUri : path;
+      if (path.endsWith('.wasm')) return wasmUri;
+      return path;
     }
   });
   
   await new Promise(resolve => {
-    _switchResEMCModule.then(() => resolve());
+    switchResEMCModule.then(() => resolve());
+  });
+  
+  return (methodName, inputStr) => Promise.resolve(switchResEMCModule.ccall(methodName, 'string', ['string'], [inputStr]));
+}
+
+interface ISwitchResWorkerMessage {
+  id?    : number;
+  output?: string;
+  err?   : string;
+}
+
+// calc_modelines_bulk waits on its pthreads, which would freeze the page,
+// so the pthreads build runs in its bulk worker
+// (groovymame_0210_switchres/web/bulk_worker.js) and calls are posted to it
+function initSwitchResWorker({bulkWorkerUri, moduleUri, wasmUri, workerUri}: ISwitchResThreadsImport): Promise<TSwitchResCall> {
+  const worker = new Worker(bulkWorkerUri);
+  const pendingCalls = new Map<number, {resolve: (outputStr: string) => void; reject: (err: Error) => void}>();
+  let nextCallId = 0;
+  
+  const call: TSwitchResCall = (methodName, inputStr) => new Promise((resolve, reject) => {
+    const id = nextCallId++;
+    pendingCalls.set(id, {resolve, reject});
+    worker.postMessage({id, method: methodName, input: inputStr});
+  });
+  
+  return new Promise((resolve, reject) => {
+    worker.onmessage = (event: MessageEvent): void => {
+      const message = event.data as ISwitchResWorkerMessage;
+      
+      // the answer to the module load
+      if (message.id === undefined) {
+        if (message.err !== undefined) reject(new Error(`Unable to load the SwitchRes module: ${message.err}`));
+        else resolve(call);
+        return;
+      }
+      
+      const pendingCall = pendingCalls.get(message.id);
+      if (!pendingCall) return;
+      pendingCalls.delete(message.id);
+      
+      if (message.err !== undefined) pendingCall.reject(new Error(message.err));
+      else pendingCall.resolve(message.output || '');
+    };
+    
+    worker.onerror = (event: ErrorEvent): void => {
+      const err = new Error(`SwitchRes worker error: ${event.message}`);
+      reject(err);
+      for (const pendingCall of pendingCalls.values()) {
+        pendingCall.reject(err);
+      }
+      pendingCalls.clear();
+    };
+    
+    worker.postMessage({moduleUri, wasmUri, workerUri});
   });
+}
+
+let switchResThreads = false;
+
+async function _init(): Promise<void> {
+  const switchResImport = await importSwitchRes();
   
-  switchResEMCModule = _switchResEMCModule;
+  switchResCall = switchResImport.threads
+    ? await initSwitchResWorker(switchResImport)
+    : await initSwitchResModule(switchResImport);
+  switchResThreads = switchResImport.threads;
 }
 
 let initPromise: Promise<void> | null = null;
@@ -80,7 +234,7 @@ export async function calcModelineBulk(
   modelineConfig: IModelineConfiguration,
   games         : IGame[]
 ): Promise<Map<IGame, TModelineCalculation>> {
-  if (!switchResEMCModule) throw new Error(`Not initalized.`);
+  if (!switchResCall) throw new Error(`Not initalized.`);
   
   const calcMap = new Map<IGame, TModelineCalculation>();
   
@@ -136,16 +290,31 @@ export async function calcModelineBulk(
     return calcMap;
   }
   
-  // calculate modelines
-  const outputStr: string = switchResEMCModule.ccall(
-    'calc_modelines',
-    'string',
-    ['string'],
-    [JSON.stringify(serializeSwitchResInput(input))]
-  );
-  
-  // parse the output
-  const outputMap = parseSwitchResOutput(outputStr);
+  // calculate modelines, the pthreads build splits the machines across its
+  // workers and returns the outputs in input order
+  let outputMap: Map<string, TSwitchResOutput>;
+  if (switchResThreads) {
+    const outputStr = await switchResCall(
+      'calc_modelines_bulk',
+      JSON.stringify({
+        ...(serializeSwitchResInput(input) as IJSONObject),
+        threads: navigator.hardwareConcurrency || 0
+      })
+    );
+    
+    const outputs = parseSwitchResBulkOutput(outputStr);
+    if (outputs.length !== input.machines.length) throw new Error(`Bulk output length does not match the input.`);
+    outputMap = new Map(input.machines.map((machine, i): [string, TSwitchResOutput] => [machine.name, outputs[i]]));
+  }
+  else {
+    const outputStr = await switchResCall(
+      'calc_modelines',
+      JSON.stringify(serializeSwitchResInput(input))
+    );
+    
+    // parse the output
+    outputMap = parseSwitchResOutput(outputStr);
+  }
   
   // for each output...
   for (const [gameName, output] of outputMap) {
@@ -216,6 +385,21 @@ function parseSwitchResOutput(outputStr: string): Map<string, TSwitchResOutput>
   }
 }
 
+function parseSwitchResBulkOutput(outputStr: string): TSwitchResOutput[] {
+  let sOutput: TJSONValue;
+  try {
+    sOutput = JSON.parse(outputStr);
+  } catch (err) {
+    throw new Error(`Output is not valid JSON:\n${err.message}:\n${outputStr}`);
+  }
+  
+  try {
+    return deserializeArray(sOutput, 'sOutputs', deserializeSwitchResOutput);
+  } catch (err) {
+    throw new Error(`Error deserializing SwitchRes output:\n${err.message}:\n${outputStr}`);
+  }
+}
+
 function createModelineCalculation(
   output        : TSwitchResOutput,
   modelineConfig: IModelineConfiguration
@@ -1,4 +1,20 @@
 declare module 'switchres/groovymame_0210_switchres.js' {
   const content: any; // eslint-disable-line @typescript-eslint/no-explicit-any
   export default content;
-}
\ No newline at end of file
+}
+declare module 'switchres-simd/groovymame_0210_switchres.js' {
+  const content: any; // eslint-disable-line @typescript-eslint/no-explicit-any
+  export default content;
+}
+declare module 'switchres-threads/groovymame_0210_switchres.js' {
+  const uri: string;
+  export default uri;
+}
+declare module 'switchres-threads/groovymame_0210_switchres.bulk.js' {
+  const uri: string;
+  export default uri;
+}
+declare module 'switchres-threads/groovymame_0210_switchres.worker.js' {
+  const uri: string;
+  export default uri;
+}
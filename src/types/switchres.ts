@@ -10,10 +10,12 @@ export type TInitModule = (options: {
   locateFile?: (path: string) => string;
 }) => ISwitchResEMCModule;
 
+export type TSwitchResMethodName = 'calc_modelines' | 'calc_modelines_bulk';
+
 export interface ISwitchResEMCModule {
   then: (cb: () => void) => void;
   ccall(
-    methodName: 'calc_modelines',
+    methodName: TSwitchResMethodName,
     returnType: 'string',
     argTypes  : ['string'],
     args      : [string]
@@ -0,0 +1,134 @@
+/*
+ * Usage: node test/switchresRegression.cjs [native binary]
+ *
+ * Checks that the search optimizations don't change any result: the
+ * machines of switchresMachines.json are evaluated by the native
+ * calc_modelines against a set of monitor configs, once with every
+ * optimization, once with each of them disabled ("disable" input) and once
+ * with all of them disabled (the plain engine). Every run must give the
+ * same output as the plain engine:
+ *   lineCache       the horizontal line params cache
+ *   prefilter       the range prefilter before modeline_create
+ *   modeIndex       the video mode table index
+ *   defaultResults  the compiled in results of the built-in presets
+ *
+ * Build the binary first (make native), npm test does both.
+ */
+
+const fs            = require('fs');
+const path          = require('path');
+const childProcess  = require('child_process');
+
+const defaultBinary = path.join(__dirname, '../groovymame_0210_switchres/out/native/groovymame_0210_switchres');
+const optimizations = ['lineCache', 'prefilter', 'modeIndex', 'defaultResults'];
+
+const customRange = '15625-15750, 49.50-65.00, 2.000, 4.700, 8.000, 0.064, 0.192, 1.024, 0, 0, 192, 288, 448, 576';
+
+// editable and fixed modes, progressive and interlaced
+const videoModes = [
+  '  512x293   100.00+  70.00 yres',
+  '  728x223   49.50*  53.20*',
+  '  504x205   54.70  49.50* yres',
+  '536x576i@75 xres vfreq',
+  '328x576i@53.2',
+  '256x480i@100',
+  '  552x217   120.00  61.00 yres',
+  '456x241@49.5',
+  '680x480i@50',
+  '560x267@60 yres',
+  '600x512i@59.1 yres',
+  '  576x576i   53.20  49.50+',
+  '  616x194   75.00*  58.00+',
+  '264x282@60',
+  '376x296@57.5 vfreq',
+  '616x224@50 vfreq',
+  '632x196@50',
+  '600x238@57.5',
+  '344x232@53.2 xres vfreq',
+  '  336x284   55.00+  59.10',
+  '336x260@49.5',
+  '  608x250   58.00+  53.20',
+  '760x218@70 vfreq',
+  '384x292@50',
+  '696x199@55',
+  '720x271@59.94 custom',
+  '752x232@55',
+  '736x210@58 xres vfreq',
+  '800x272@100',
+  '  440x512i   75.00+  59.94* xres vfreq',
+  '320x291@70 vfreq',
+  '  288x238   70.00*  61.00*'
+];
+
+const configs = {
+  'arcade_15 horizontal':       {preset: 'arcade_15',       orientation: 'horizontal'},
+  'arcade_15_25_31 horizontal': {preset: 'arcade_15_25_31', orientation: 'horizontal'},
+  'arcade_15_25_31 vertical':   {preset: 'arcade_15_25_31', orientation: 'vertical'},
+  'arcade_15_25_31 rotate':     {preset: 'arcade_15_25_31', orientation: 'rotate'},
+  'generic_15 default':         {preset: 'generic_15'},
+  'd9800 horizontal':           {preset: 'd9800',           orientation: 'horizontal'},
+  'ms2930 vertical':            {preset: 'ms2930',          orientation: 'vertical'},
+  'pc_31_120 horizontal':       {preset: 'pc_31_120',       orientation: 'horizontal'},
+  'vesa_480 rotate':            {preset: 'vesa_480',        orientation: 'rotate'},
+  'custom':                     {preset: 'custom', orientation: 'horizontal', ranges: [customRange]},
+  'custom progressive':         {preset: 'custom', orientation: 'horizontal', ranges: [customRange], allowInterlaced: false, allowDoublescan: false},
+  'custom dotclock min':        {preset: 'custom', orientation: 'horizontal', ranges: [customRange], dotclockMin: 25},
+  'arcade_15 video modes':      {preset: 'arcade_15', orientation: 'horizontal', videoModes},
+  'arcade_15 unlocked modes':   {preset: 'arcade_15', orientation: 'horizontal', videoModes, lockSystemModes: false}
+};
+
+function calcModelines(binary, input) {
+  const result = childProcess.spawnSync(binary, ['-'], {
+    input: JSON.stringify(input),
+    maxBuffer: 256 * 1024 * 1024,
+    stdio: ['pipe', 'pipe', 'ignore']
+  });
+  if (result.error) throw result.error;
+  if (result.status !== 0) {
+    throw new Error(`${binary} exited with ${result.status}`);
+  }
+  return JSON.parse(result.stdout.toString());
+}
+
+// the names of the machines whose results differ
+function diffOutputs(expected, actual) {
+  const names = new Set([...Object.keys(expected), ...Object.keys(actual)]);
+  return [...names].filter(name => JSON.stringify(expected[name]) !== JSON.stringify(actual[name]));
+}
+
+(function run() {
+  const binary = process.argv[2] || defaultBinary;
+  if (!fs.existsSync(binary)) {
+    console.error(`${binary} not found, build it with make native`);
+    process.exit(1);
+  }
+
+  const {machines} = JSON.parse(fs.readFileSync(path.join(__dirname, 'switchresMachines.json'), 'utf8'));
+  const variants = [
+    {name: 'all optimizations', disable: []},
+    ...optimizations.map(optimization => ({name: `no ${optimization}`, disable: [optimization]}))
+  ];
+
+  let failures = 0;
+  for (const [configName, config] of Object.entries(configs)) {
+    const reference = calcModelines(binary, {config, machines, disable: optimizations});
+    if (reference.err) {
+      throw new Error(`${configName}: ${reference.err}`);
+    }
+
+    for (const variant of variants) {
+      const output = calcModelines(binary, {config, machines, disable: variant.disable});
+      const mismatches = diffOutputs(reference, output);
+      if (mismatches.length) {
+        ++failures;
+        console.error(`FAIL ${configName}, ${variant.name}: ${mismatches.length} machines differ from the plain engine (${mismatches.slice(0, 10).join(', ')})`);
+      }
+    }
+    console.log(`ok ${configName} (${Object.keys(reference).length} machines)`);
+  }
+
+  if (failures) {
+    console.error(`${failures} mismatching runs`);
+    process.exit(1);
+  }
+})();
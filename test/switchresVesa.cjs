@@ -0,0 +1,83 @@
+/*
+ * Usage: node test/switchresVesa.cjs [native binary]
+ *
+ * Checks the CVT and CVT reduced blanking timings of the native vesa
+ * command against the published VESA CVT 1.2 timings (as given by the
+ * VESA spreadsheet and the cvt tool):
+ *   pclock (Hz), hactive, hsync start, hsync end, htotal,
+ *   vactive, vsync start, vsync end, vtotal, +hsync, +vsync
+ *
+ * Build the binary first (make native), npm test does both.
+ */
+
+const fs            = require('fs');
+const path          = require('path');
+const childProcess  = require('child_process');
+
+const defaultBinary = path.join(__dirname, '../groovymame_0210_switchres/out/native/groovymame_0210_switchres');
+const fields = ['pclock', 'hactive', 'hbegin', 'hend', 'htotal', 'vactive', 'vbegin', 'vend', 'vtotal', 'hsync', 'vsync'];
+
+const references = {
+  'cvt': {
+    '640x480@60':   [ 23750000,  640,  656,  720,  800,  480,  483,  487,  500, 0, 1],
+    '800x600@60':   [ 38250000,  800,  832,  912, 1024,  600,  603,  607,  624, 0, 1],
+    '1024x768@60':  [ 63500000, 1024, 1072, 1176, 1328,  768,  771,  775,  798, 0, 1],
+    '1280x720@60':  [ 74500000, 1280, 1344, 1472, 1664,  720,  723,  728,  748, 0, 1],
+    '1920x1080@60': [173000000, 1920, 2048, 2248, 2576, 1080, 1083, 1088, 1120, 0, 1]
+  },
+  'cvt-rb': {
+    '1280x800@60':  [ 71000000, 1280, 1328, 1360, 1440,  800,  803,  809,  823, 1, 0],
+    '1680x1050@60': [119000000, 1680, 1728, 1760, 1840, 1050, 1053, 1059, 1080, 1, 0],
+    '1920x1080@60': [138500000, 1920, 1968, 2000, 2080, 1080, 1083, 1088, 1111, 1, 0],
+    '1920x1200@60': [154000000, 1920, 1968, 2000, 2080, 1200, 1203, 1209, 1235, 1, 0]
+  }
+};
+
+function calcVesaModelines(binary, input) {
+  const result = childProcess.spawnSync(binary, ['vesa', '-'], {
+    input: JSON.stringify(input),
+    stdio: ['pipe', 'pipe', 'ignore']
+  });
+  if (result.error) throw result.error;
+  return JSON.parse(result.stdout.toString());
+}
+
+(function run() {
+  const binary = process.argv[2] || defaultBinary;
+  if (!fs.existsSync(binary)) {
+    console.error(`${binary} not found, build it with make native`);
+    process.exit(1);
+  }
+
+  let failures = 0;
+  for (const [formula, modes] of Object.entries(references)) {
+    const names = Object.keys(modes);
+    const output = calcVesaModelines(binary, {
+      formula,
+      modes: names.map(name => name.split(/[x@]/).map(Number))
+    });
+    if (output.err) {
+      throw new Error(`${formula}: ${output.err}`);
+    }
+
+    names.forEach((name, i) => {
+      const modeline = output.modelines[i];
+      const actual = fields.map(field => modeline[output.fields.indexOf(field)]);
+      if (JSON.stringify(actual) !== JSON.stringify(modes[name])) {
+        ++failures;
+        console.error(`FAIL ${formula} ${name}: ${actual.join(' ')}, expected ${modes[name].join(' ')}`);
+      }
+    });
+    console.log(`ok ${formula} (${names.length} modes)`);
+  }
+
+  if (!calcVesaModelines(binary, {formula: 'cvt-r', modes: [[640, 480, 60]]}).err) {
+    ++failures;
+    console.error('FAIL an unknown formula is accepted');
+  }
+
+  if (failures) {
+    console.error(`${failures} mismatching modes`);
+    process.exit(1);
+  }
+})();
@@ -0,0 +1,258 @@
+/*
+ * Usage: node switchresStartup.cjs [build dir] [--runs <n>] [--baseline <report.json>]
+ *
+ * Measures the startup cost of an emscripten switchres build: the size of
+ * the module files (raw and gzipped, as served), the time to compile and
+ * instantiate the wasm and the latency of the first calc_modelines call on
+ * a fresh instance. Each run loads a new instance and the median of the
+ * runs is reported as JSON. With --baseline the change from an earlier
+ * report is printed to stderr so startup regressions are visible.
+ *
+ * A .cjs script since the package is an ES module, the emscripten output
+ * is CommonJS and evaluated as such here.
+ *
+ * The pthreads build (out/wasm-threads) needs a browser's workers and is
+ * not supported.
+ */
+
+const fs   = require('fs');
+const path = require('path');
+const zlib = require('zlib');
+const {performance} = require('perf_hooks');
+
+const usageExampleStr =
+`node switchresStartup.cjs [build dir] [--runs <n>] [--baseline <report.json>]
+
+cd groovymame_0210_switchres
+node ../tools/switchresStartup.cjs out/wasm > startup.json
+node ../tools/switchresStartup.cjs out/wasm-simd --baseline startup.json`;
+
+const TARGET_NAME = 'groovymame_0210_switchres';
+
+/** @type {any} */
+const WebAssembly = /** @type {any} */(global).WebAssembly;
+
+// a built-in preset (results compiled in) and a custom range (searched)
+const sampleMachines = [
+  {name: 'pacman', display: {type: 'raster', rotate: 90, flipx: false, refresh: 60.606061, width: 288, height: 224}},
+  {name: 'sf2',    display: {type: 'raster', rotate: 0,  flipx: false, refresh: 59.637405, width: 384, height: 224}},
+];
+const sampleInputs = {
+  preset: {
+    config: {preset: 'arcade_15', orientation: 'horizontal', ranges: [], allowInterlaced: true, allowDoublescan: true},
+    machines: sampleMachines
+  },
+  custom: {
+    config: {
+      preset: 'custom',
+      orientation: 'horizontal',
+      ranges: ['15625-15750, 49.50-65.00, 2.000, 4.700, 8.000, 0.064, 0.192, 1.024, 0, 0, 192, 288, 448, 576'],
+      allowInterlaced: true,
+      allowDoublescan: true
+    },
+    machines: sampleMachines
+  }
+};
+
+(async function run() {
+  const args = process.argv.slice(2);
+  let buildDir = 'out/wasm';
+  let runs = 5;
+  /** @type {string | undefined} */
+  let baselinePath;
+
+  for (let i = 0; i < args.length; ++i) {
+    if (args[i] === '--runs') {
+      runs = parseInt(args[++i], 10);
+    }
+    else if (args[i] === '--baseline') {
+      baselinePath = args[++i];
+    }
+    else if (/^-?-h(elp)?$/i.test(args[i])) {
+      console.error(`Usage:\n${usageExampleStr}`);
+      process.exit(0);
+    }
+    else {
+      buildDir = args[i];
+    }
+  }
+  if (!(runs > 0) || (args.includes('--baseline') && !baselinePath)) {
+    console.error(`Usage:\n${usageExampleStr}`);
+    process.exit(1);
+  }
+
+  const jsPath   = path.resolve(buildDir, `${TARGET_NAME}.js`);
+  const wasmPath = path.resolve(buildDir, `${TARGET_NAME}.wasm`);
+  if (!fs.existsSync(jsPath)) {
+    throw new Error(`No switchres build in '${buildDir}' (missing ${jsPath}).`);
+  }
+  // the asm.js build has no .wasm, the code is in the .js
+  const wasmBytes = fs.existsSync(wasmPath)? fs.readFileSync(wasmPath) : undefined;
+
+  /** @type {Record<string, number[]>} */
+  const samples = {};
+  for (let i = 0; i < runs; ++i) {
+    const sample = await measureStartup(jsPath, wasmBytes);
+    for (const [name, value] of Object.entries(sample)) {
+      (samples[name] = samples[name] || []).push(value);
+    }
+  }
+
+  /** @type {Record<string, number>} */
+  const timesMs = {};
+  for (const [name, values] of Object.entries(samples)) {
+    timesMs[name] = round(median(values));
+  }
+
+  const report = {
+    build : buildDir,
+    runs,
+    node  : process.version,
+    sizes : {
+      js  : fileSizes(fs.readFileSync(jsPath)),
+      wasm: wasmBytes? fileSizes(wasmBytes) : null
+    },
+    timesMs
+  };
+
+  if (baselinePath) {
+    const baseline = JSON.parse(fs.readFileSync(baselinePath, 'utf8'));
+    printComparison(baseline, report);
+  }
+
+  console.log(JSON.stringify(report, null, 2));
+})()
+.then(() => {
+  process.exit(0);
+})
+.catch(err => {
+  console.error(err);
+  process.exit(1);
+});
+
+/**
+ * Loads a fresh instance of the module. The wasm is compiled and
+ * instantiated here (through emscripten's instantiateWasm hook) so the two
+ * steps are timed apart.
+ *
+ * @param {string} jsPath
+ * @param {Buffer | undefined} wasmBytes
+ * @returns {Promise<Record<string, number>>}
+ */
+async function measureStartup(jsPath, wasmBytes) {
+  /** @type {Record<string, number>} */
+  const sample = {};
+
+  // a new instance of the factory for every run. require() would load the
+  // .js as an ES module because of the package's "type"
+  let start = performance.now();
+  const source = fs.readFileSync(jsPath, 'utf8');
+  const factoryModule = {exports: {}};
+  new Function('module', 'exports', 'require', '__filename', '__dirname', source)(
+    factoryModule, factoryModule.exports, require, jsPath, path.dirname(jsPath)
+  );
+  /** @type {any} */
+  const initModule = factoryModule.exports;
+  sample.load = performance.now() - start;
+
+  /** @type {any} */
+  let compiledModule;
+  if (wasmBytes) {
+    start = performance.now();
+    compiledModule = await WebAssembly.compile(wasmBytes);
+    sample.compile = performance.now() - start;
+  }
+
+  start = performance.now();
+  /** @type {any} */
+  const switchRes = initModule({
+    /**
+     * @param {any} imports
+     * @param {(instance: any, module: any) => void} successCallback
+     */
+    instantiateWasm(imports, successCallback) {
+      const instantiateStart = performance.now();
+      WebAssembly.instantiate(compiledModule, imports)
+      .then((/** @type {any} */instance) => {
+        sample.instantiate = performance.now() - instantiateStart;
+        successCallback(instance, compiledModule);
+      })
+      .catch((/** @type {any} */err) => {
+        console.error(err);
+        process.exit(1);
+      });
+      return {};
+    }
+  });
+
+  // the module's then() resolves with the module which is itself a
+  // thenable, so don't return it from the promise
+  await new Promise(resolve => switchRes.then(() => resolve(undefined)));
+  sample.ready = performance.now() - start;
+
+  for (const [name, input] of Object.entries(sampleInputs)) {
+    start = performance.now();
+    const outputStr = switchRes.ccall('calc_modelines', 'string', ['string'], [JSON.stringify(input)]);
+    const time = performance.now() - start;
+
+    const output = JSON.parse(outputStr);
+    if (output.err) {
+      throw new Error(`calc_modelines failed on the ${name} sample: ${output.err}`);
+    }
+    sample[`firstCalc.${name}`] = time;
+  }
+
+  return sample;
+}
+
+/**
+ * @param {Buffer} bytes
+ */
+function fileSizes(bytes) {
+  return {
+    bytes    : bytes.length,
+    gzipBytes: zlib.gzipSync(bytes, {level: 9}).length
+  };
+}
+
+/**
+ * Prints each size and time of the report next to the baseline's.
+ *
+ * @param {any} baseline
+ * @param {any} report
+ */
+function printComparison(baseline, report) {
+  /** @type {[string, number | undefined, number | undefined][]} */
+  const rows = [];
+  for (const file of ['js', 'wasm']) {
+    for (const size of ['bytes', 'gzipBytes']) {
+      rows.push([`${file}.${size}`, (baseline.sizes[file] || {})[size], (report.sizes[file] || {})[size]]);
+    }
+  }
+  for (const name of Object.keys(report.timesMs)) {
+    rows.push([`${name} (ms)`, baseline.timesMs[name], report.timesMs[name]]);
+  }
+
+  console.error(`${baseline.build} -> ${report.build}`);
+  for (const [name, before, after] of rows) {
+    if (before === undefined || after === undefined) continue;
+    const change = before? `${after >= before? '+' : ''}${round((after - before) / before * 100)}%` : '';
+    console.error(`  ${name.padEnd(24)} ${String(before).padStart(10)} ${String(after).padStart(10)} ${change.padStart(9)}`);
+  }
+}
+
+/**
+ * @param {number[]} values
+ */
+function median(values) {
+  const sorted = values.slice().sort((a, b) => a - b);
+  const mid = Math.floor(sorted.length / 2);
+  return sorted.length % 2? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+}
+
+/**
+ * @param {number} value
+ */
+function round(value) {
+  return Math.round(value * 100) / 100;
+}
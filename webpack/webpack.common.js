@@ -121,6 +121,21 @@ module.exports = function makeConfig(mode) {
               name: '[name].[contenthash].[ext]'
             }
           }
+        },
+        
+        // the pthreads build runs in a worker (its .bulk.js) that loads the
+        // module's script, which loads the pthreads' .worker.js script, so
+        // they are all copied as is and referenced by URL like the wasm file
+        {
+          test: /\.js$/,
+          include: path.resolve(__dirname, '..', 'groovymame_0210_switchres', 'out', 'wasm-threads'),
+          type: 'javascript/auto',
+          use: {
+            loader: 'file-loader',
+            options: {
+              name: '[name].[contenthash].[ext]'
+            }
+          }
         }
       ]
     },
@@ -129,7 +144,11 @@ module.exports = function makeConfig(mode) {
       alias: {
         lib      : path.resolve(__dirname, '..', 'lib' ),
         data     : path.resolve(__dirname, '..', 'data'),
-        switchres: path.resolve(__dirname, '..', 'groovymame_0210_switchres', 'out', 'wasm')
+        switchres: path.resolve(__dirname, '..', 'groovymame_0210_switchres', 'out', 'wasm'),
+        // same module built with wasm SIMD, see importSwitchRes
+        'switchres-simd': path.resolve(__dirname, '..', 'groovymame_0210_switchres', 'out', 'wasm-simd'),
+        // pthreads build, see importSwitchRes
+        'switchres-threads': path.resolve(__dirname, '..', 'groovymame_0210_switchres', 'out', 'wasm-threads')
       },
       // allow importing TypeScript files
       extensions: ['.ts', '.tsx', '.js', '.jsx', '.json']